@@ -0,0 +1,668 @@
+#include "AudioDecoder.h"
+#include "AudioMix.h"
+#include "CodecThreadBudget.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/channel_layout.h>
+}
+
+// FFmpeg's channel order for these layouts matches the AL_EXT_MCFORMATS
+// formats (front, center, LFE, back, side), so they pass through as-is.
+// Anything else is remixed by swresample into the nearest one.
+static void CarrierLayout(const AVChannelLayout& in, AVChannelLayout* out) {
+    static const uint64_t native[] = {
+        AV_CH_LAYOUT_STEREO, AV_CH_LAYOUT_QUAD, AV_CH_LAYOUT_5POINT1,
+        AV_CH_LAYOUT_5POINT1_BACK, AV_CH_LAYOUT_7POINT1
+    };
+    if (in.order == AV_CHANNEL_ORDER_NATIVE) {
+        for (uint64_t mask : native) {
+            if (in.u.mask == mask) {
+                av_channel_layout_from_mask(out, mask);
+                return;
+            }
+        }
+    }
+
+    int n = in.nb_channels;
+    uint64_t mask = n <= 2 ? AV_CH_LAYOUT_STEREO
+                  : n <= 4 ? AV_CH_LAYOUT_QUAD
+                  : n <= 6 ? AV_CH_LAYOUT_5POINT1
+                  : AV_CH_LAYOUT_7POINT1;
+    av_channel_layout_from_mask(out, mask);
+}
+
+// Threads worth giving a codec. Most audio decodes far faster than real
+// time on one core, where frame threading only adds delay; the lossless
+// codecs below get heavy at high rates or channel counts.
+static int CodecThreads(const AVCodec* codec, const AVCodecParameters* par) {
+    if (!(codec->capabilities & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)))
+        return 1;
+
+    int64_t load = static_cast<int64_t>(par->sample_rate) * par->ch_layout.nb_channels;
+    switch (codec->id) {
+    case AV_CODEC_ID_APE:
+    case AV_CODEC_ID_WAVPACK:
+    case AV_CODEC_ID_TAK:
+        return load > 2 * 48000 ? 4 : 2;
+    case AV_CODEC_ID_FLAC:
+    case AV_CODEC_ID_ALAC:
+        return load > 2 * 96000 ? 4 : load > 2 * 48000 ? 2 : 1;
+    default:
+        return 1;
+    }
+}
+
+// A decoded float copy is several times the size of the source, so only
+// codecs slow enough to decode are worth one on disk: the heavy lossless
+// formats, and FLAC/ALAC above 48 kHz stereo. Everything else decodes
+// faster than a large file can be read back.
+static bool WorthDiskCache(const AVCodecParameters* par) {
+    int64_t load = static_cast<int64_t>(par->sample_rate) * par->ch_layout.nb_channels;
+    switch (par->codec_id) {
+    case AV_CODEC_ID_APE:
+    case AV_CODEC_ID_WAVPACK:
+    case AV_CODEC_ID_TAK:
+        return true;
+    case AV_CODEC_ID_FLAC:
+    case AV_CODEC_ID_ALAC:
+        return load > 2 * 48000;
+    default:
+        return false;
+    }
+}
+
+static bool IsDirectFormat(int format) {
+    switch (format) {
+    case AV_SAMPLE_FMT_FLT:
+    case AV_SAMPLE_FMT_FLTP:
+    case AV_SAMPLE_FMT_S16:
+    case AV_SAMPLE_FMT_S16P:
+    case AV_SAMPLE_FMT_S32:
+    case AV_SAMPLE_FMT_S32P:
+        return true;
+    default:
+        return false;
+    }
+}
+
+AudioDecoder::~AudioDecoder() {
+    close();
+    av_frame_free(&m_frame);
+    av_packet_free(&m_packet);
+}
+
+void AudioDecoder::setGeneration(const std::atomic<uint32_t>* generation, uint32_t expected) {
+    m_generation = generation;
+    m_expected.store(expected, std::memory_order_relaxed);
+}
+
+int AudioDecoder::interruptCallback(void* opaque) {
+    // Runs on the read-ahead thread while it is blocked in I/O.
+    auto* self = static_cast<const AudioDecoder*>(opaque);
+    return self->cancelled() || self->m_reader.stopping() ? 1 : 0;
+}
+
+int AudioDecoder::readImage(void* opaque, uint8_t* buf, int size) {
+    auto* self = static_cast<AudioDecoder*>(opaque);
+    const std::vector<uint8_t>& bytes = self->m_image->bytes;
+    size_t n = std::min(static_cast<size_t>(size), bytes.size() - self->m_imagePos);
+    if (n == 0) return AVERROR_EOF;
+    std::copy_n(bytes.data() + self->m_imagePos, n, buf);
+    self->m_imagePos += n;
+    return static_cast<int>(n);
+}
+
+int64_t AudioDecoder::seekImage(void* opaque, int64_t offset, int whence) {
+    auto* self = static_cast<AudioDecoder*>(opaque);
+    int64_t size = static_cast<int64_t>(self->m_image->bytes.size());
+    if (whence & AVSEEK_SIZE) return size;
+
+    int64_t base = 0;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET: base = 0; break;
+    case SEEK_CUR: base = static_cast<int64_t>(self->m_imagePos); break;
+    case SEEK_END: base = size; break;
+    default: return AVERROR(EINVAL);
+    }
+    int64_t pos = base + offset;
+    if (pos < 0 || pos > size) return AVERROR(EINVAL);
+    self->m_imagePos = static_cast<size_t>(pos);
+    return pos;
+}
+
+bool AudioDecoder::open(const std::string& path) {
+    close();
+
+    m_path = path;
+    m_stamp = SourceStamp::of(path);
+    if (openCached(path)) return true;
+
+    m_fmt = avformat_alloc_context();
+    m_fmt->interrupt_callback.callback = &AudioDecoder::interruptCallback;
+    m_fmt->interrupt_callback.opaque = this;
+
+    // Prefetched files are demuxed from memory. The path is still passed
+    // to avformat_open_input as a probing hint.
+    if (m_prefetch) m_image = m_prefetch->find(path);
+    if (m_image) {
+        constexpr int AVIO_BUFFER = 64 * 1024;
+        auto* buffer = static_cast<unsigned char*>(av_malloc(AVIO_BUFFER));
+        if (buffer)
+            m_avio = avio_alloc_context(buffer, AVIO_BUFFER, 0, this,
+                                        &AudioDecoder::readImage, nullptr, &AudioDecoder::seekImage);
+        if (!m_avio) {
+            av_free(buffer);
+            m_image.reset();
+        } else {
+            m_fmt->pb = m_avio;
+            m_fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    }
+
+    if (avformat_open_input(&m_fmt, path.c_str(), nullptr, nullptr) < 0) {
+        if (!cancelled())
+            std::cerr << "Failed to open file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    if (avformat_find_stream_info(m_fmt, nullptr) < 0) {
+        close();
+        return false;
+    }
+
+    m_streamIdx = av_find_best_stream(m_fmt, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (m_streamIdx < 0) {
+        close();
+        return false;
+    }
+
+    AVStream* audio_stream = m_fmt->streams[m_streamIdx];
+    const AVCodec* codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
+    if (!codec) {
+        close();
+        return false;
+    }
+
+    m_codec = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(m_codec, audio_stream->codecpar);
+
+    // Extra codec threads come out of the process-wide budget.
+    m_extraThreads = CodecThreadBudget::global().acquire(CodecThreads(codec, audio_stream->codecpar) - 1);
+    if (m_extraThreads > 0) {
+        m_codec->thread_count = 1 + m_extraThreads;
+        m_codec->thread_type = 0;
+        if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) m_codec->thread_type |= FF_THREAD_FRAME;
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) m_codec->thread_type |= FF_THREAD_SLICE;
+    } else {
+        m_codec->thread_count = 1;
+    }
+
+    if (avcodec_open2(m_codec, codec, nullptr) < 0) {
+        close();
+        return false;
+    }
+
+    AVChannelLayout in_layout = {};
+    if (m_codec->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
+        av_channel_layout_default(&in_layout, m_codec->ch_layout.nb_channels);
+    else
+        av_channel_layout_copy(&in_layout, &m_codec->ch_layout);
+
+    AVChannelLayout out_layout = {};
+    CarrierLayout(in_layout, &out_layout);
+
+    // Plain format conversion in the source layout is done by our own
+    // kernels; swresample is only set up when channels must be remixed or
+    // the sample format is one we do not handle.
+    m_direct = av_channel_layout_compare(&in_layout, &out_layout) == 0 &&
+               IsDirectFormat(m_codec->sample_fmt);
+    if (!m_direct) {
+        m_swr = swr_alloc();
+        av_opt_set_chlayout(m_swr, "in_chlayout", &in_layout, 0);
+        av_opt_set_int(m_swr, "in_sample_rate", m_codec->sample_rate, 0);
+        av_opt_set_sample_fmt(m_swr, "in_sample_fmt", m_codec->sample_fmt, 0);
+        av_opt_set_chlayout(m_swr, "out_chlayout", &out_layout, 0);
+        av_opt_set_int(m_swr, "out_sample_rate", m_codec->sample_rate, 0);
+        av_opt_set_sample_fmt(m_swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+    }
+    av_channel_layout_uninit(&in_layout);
+
+    if (m_swr && swr_init(m_swr) < 0) {
+        av_channel_layout_uninit(&out_layout);
+        close();
+        return false;
+    }
+
+    m_carrierChannels = out_layout.nb_channels;
+    m_channels = m_carrierChannels;
+    if (m_carrierChannels > m_maxChannels) {
+        buildDownmix(out_layout);
+        m_channels = 2;
+    }
+    av_channel_layout_uninit(&out_layout);
+
+    m_sampleRate = m_codec->sample_rate;
+    m_startPts = audio_stream->start_time != AV_NOPTS_VALUE ? audio_stream->start_time : 0;
+
+    // A stored table makes the index complete up front; otherwise it is
+    // built while decoding.
+    m_index.reset(static_cast<int64_t>(SEEK_INDEX_SPACING / av_q2d(audio_stream->time_base)));
+    m_indexLive = !(m_seekTables && m_seekTables->load(path, m_stamp, m_index));
+    m_byteSeek = !(m_fmt->iformat->flags & AVFMT_NO_BYTE_SEEK);
+
+    if (audio_stream->duration != AV_NOPTS_VALUE)
+        m_duration = audio_stream->duration * av_q2d(audio_stream->time_base);
+    else if (m_fmt->duration != AV_NOPTS_VALUE)
+        m_duration = static_cast<double>(m_fmt->duration) / AV_TIME_BASE;
+    else
+        m_duration = 0.0;
+    if (m_indexLive) m_index.reserve(static_cast<size_t>(m_duration / SEEK_INDEX_SPACING) + 16);
+
+    // Conversion buffers only ever grow, and are kept across tracks; size
+    // them for a typical frame now so decoding starts without reallocating.
+    size_t frameSize = static_cast<size_t>(std::max(m_codec->frame_size, 4608));
+    m_pending.reserve(frameSize * m_carrierChannels);
+    if (!m_downmix.empty()) m_carrier.reserve(frameSize * m_carrierChannels);
+
+    if (!m_packet) m_packet = av_packet_alloc();
+    if (!m_frame) m_frame = av_frame_alloc();
+    m_reader.start(m_fmt, m_streamIdx, m_readAhead);
+
+    // Capture the decoded track for the caches. Only the start of the
+    // in-memory copy is reserved here, as many opens are skipped or seeked
+    // away from; tracks too long for it only go to disk.
+    if (m_cache && !m_cacheKey.empty()) {
+        m_captureLimit = m_cache->maxEntryBytes() / sizeof(float);
+        const size_t second = static_cast<size_t>(m_sampleRate) * m_channels;
+        size_t expected = static_cast<size_t>(m_duration * m_sampleRate) * m_channels;
+        if (expected <= m_captureLimit) {
+            m_capture = std::make_shared<PcmCache::Track>();
+            m_capture->sampleRate = m_sampleRate;
+            m_capture->channels = m_channels;
+            m_captureExpected = std::min(expected + second, m_captureLimit);
+            m_capture->samples.reserve(std::min(m_captureExpected, second * CAPTURE_START_SECONDS));
+        }
+    }
+    if (m_diskCache && WorthDiskCache(m_fmt->streams[m_streamIdx]->codecpar))
+        m_diskWriter = m_diskCache->beginWrite(path, m_stamp, m_sampleRate, m_channels, m_duration);
+    return true;
+}
+
+bool AudioDecoder::openCached(const std::string& path) {
+    if (!m_cache && !m_diskCache) return false;
+
+    if (m_cache) {
+        m_cacheKey = PcmCache::keyFor(path, m_stamp);
+        auto track = m_cache->find(m_cacheKey);
+        if (track && track->channels <= m_maxChannels) {
+            m_cachedData = track->samples.data();
+            m_cachedSamples = track->samples.size();
+            m_channels = track->channels;
+            m_sampleRate = track->sampleRate;
+            m_cachedHold = std::move(track);
+        }
+    }
+    if (!m_cachedData && m_diskCache) {
+        auto mapped = m_diskCache->find(path, m_stamp);
+        if (mapped && mapped->channels() <= m_maxChannels) {
+            m_cachedData = mapped->samples();
+            m_cachedSamples = mapped->frames() * mapped->channels();
+            m_channels = mapped->channels();
+            m_sampleRate = mapped->sampleRate();
+            m_cachedHold = std::move(mapped);
+        }
+    }
+    if (!m_cachedData) return false;
+
+    m_duration = static_cast<double>(m_cachedSamples / m_channels) / m_sampleRate;
+    return true;
+}
+
+void AudioDecoder::capture(const float* samples, size_t count) {
+    if (m_capture) {
+        std::vector<float>& captured = m_capture->samples;
+        size_t need = captured.size() + count;
+        if (need > m_captureLimit) {
+            m_capture.reset();
+        } else {
+            // Still capturing past the start, the track is being played
+            // through: reserve the rest of its expected length in one go.
+            if (need > captured.capacity())
+                captured.reserve(std::max(need, m_captureExpected));
+            captured.insert(captured.end(), samples, samples + count);
+        }
+    }
+    if (m_diskWriter && !m_diskWriter->append(samples, count))
+        m_diskWriter.reset();
+}
+
+void AudioDecoder::finishCapture() {
+    if (!cancelled()) {
+        if (m_capture && !m_capture->samples.empty())
+            m_cache->insert(m_cacheKey, std::move(m_capture));
+        if (m_diskWriter)
+            m_diskWriter->commit();
+    }
+    dropCapture();
+}
+
+void AudioDecoder::dropCapture() {
+    m_capture.reset();
+    // An uncommitted writer deletes its temporary file.
+    m_diskWriter.reset();
+}
+
+size_t AudioDecoder::readCached(float* out, size_t frames) {
+    size_t n = std::min(frames, (m_cachedSamples - m_cachedPos) / m_channels);
+    std::copy_n(m_cachedData + m_cachedPos, n * m_channels, out);
+    m_cachedPos += n * m_channels;
+    if (m_cachedPos >= m_cachedSamples) m_eof = true;
+    return n;
+}
+
+void AudioDecoder::close() {
+    m_reader.stop();
+    dropCapture();
+    m_cachedHold.reset();
+    m_cachedData = nullptr;
+    m_cachedSamples = 0;
+    m_cachedPos = 0;
+    m_cacheKey.clear();
+    m_stamp = {};
+    m_path.clear();
+    if (m_frame) av_frame_unref(m_frame);
+    if (m_packet) av_packet_unref(m_packet);
+    if (m_swr) swr_free(&m_swr);
+    if (m_codec) avcodec_free_context(&m_codec);
+    CodecThreadBudget::global().release(m_extraThreads);
+    m_extraThreads = 0;
+    if (m_fmt) avformat_close_input(&m_fmt);
+    // Custom I/O is left to its owner by avformat_close_input.
+    if (m_avio) {
+        av_freep(&m_avio->buffer);
+        avio_context_free(&m_avio);
+    }
+    m_image.reset();
+    m_imagePos = 0;
+
+    m_streamIdx = -1;
+    m_direct = false;
+    m_channels = 0;
+    m_carrierChannels = 0;
+    m_downmix.clear();
+    m_sampleRate = 0;
+    m_duration = 0.0;
+    m_startPts = 0;
+    m_skipTo = -1;
+    m_draining = false;
+    m_eof = false;
+    m_pending.clear();
+    m_pendingPos = 0;
+    m_index.reset(1);
+    m_indexLive = false;
+    m_byteSeek = false;
+    m_restampPos = -1;
+    m_restampPts = AV_NOPTS_VALUE;
+}
+
+size_t AudioDecoder::read(float* out, size_t frames) {
+    if (!isOpen()) return 0;
+    if (m_cachedData) return readCached(out, frames);
+
+    size_t written = 0;
+    while (written < frames) {
+        size_t available = (m_pending.size() - m_pendingPos) / m_channels;
+        if (available == 0) {
+            if (!decodeNext()) break;
+            continue;
+        }
+
+        size_t n = std::min(available, frames - written);
+        std::copy_n(m_pending.data() + m_pendingPos, n * m_channels, out + written * m_channels);
+        m_pendingPos += n * m_channels;
+        written += n;
+    }
+    return written;
+}
+
+bool AudioDecoder::seek(double seconds) {
+    if (!isOpen()) return false;
+
+    if (m_cachedData) {
+        size_t frame = static_cast<size_t>(std::max<int64_t>(std::llround(seconds * m_sampleRate), 0));
+        m_cachedPos = std::min(frame * m_channels, m_cachedSamples);
+        m_eof = m_cachedPos >= m_cachedSamples;
+        return true;
+    }
+
+    // A seeked decode no longer covers the whole track.
+    dropCapture();
+
+    AVStream* stream = m_fmt->streams[m_streamIdx];
+    int64_t ts = m_startPts + static_cast<int64_t>(seconds / av_q2d(stream->time_base));
+
+    // The reader owns the format context while it runs.
+    m_reader.stop();
+    bool ok = seekIndexed(ts);
+    if (!ok) {
+        // Outside the indexed range: let the demuxer find the spot, and
+        // stop indexing since decoding no longer continues the run.
+        m_indexLive = false;
+        m_restampPos = -1;
+        m_restampPts = AV_NOPTS_VALUE;
+        ok = av_seek_frame(m_fmt, m_streamIdx, ts, AVSEEK_FLAG_BACKWARD) >= 0;
+    }
+    m_reader.start(m_fmt, m_streamIdx, m_readAhead);
+    if (!ok) return false;
+
+    avcodec_flush_buffers(m_codec);
+    m_pending.clear();
+    m_pendingPos = 0;
+    m_draining = false;
+    m_eof = false;
+    m_skipTo = std::llround(seconds * m_sampleRate);
+    return true;
+}
+
+bool AudioDecoder::seekIndexed(int64_t ts) {
+    if (!m_byteSeek) return false;
+
+    // Start a little early so the codec can prime (MP3 bit reservoir,
+    // overlapped transforms); the excess is decoded and discarded.
+    AVStream* stream = m_fmt->streams[m_streamIdx];
+    int64_t preroll = static_cast<int64_t>(SEEK_PREROLL / av_q2d(stream->time_base));
+    const SeekIndex::Entry* entry = m_index.find(std::max(ts - preroll, m_startPts));
+    if (!entry || av_seek_frame(m_fmt, m_streamIdx, entry->pos, AVSEEK_FLAG_BYTE) < 0)
+        return false;
+
+    m_restampPos = entry->pos;
+    m_restampPts = entry->pts;
+    return true;
+}
+
+void AudioDecoder::trackPacket(AVPacket* pkt) {
+    if (m_restampPos >= 0) {
+        // Only trust the entry if the demuxer resumed exactly at it.
+        if (pkt->pos != m_restampPos) m_restampPts = AV_NOPTS_VALUE;
+        m_restampPos = -1;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        m_restampPts = AV_NOPTS_VALUE;
+    } else if (m_restampPts != AV_NOPTS_VALUE) {
+        pkt->pts = m_restampPts;
+        if (pkt->dts == AV_NOPTS_VALUE) pkt->dts = m_restampPts;
+        m_restampPts = pkt->duration > 0 ? m_restampPts + pkt->duration : AV_NOPTS_VALUE;
+    }
+
+    if (m_indexLive) {
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (pts != AV_NOPTS_VALUE) m_index.add(pts, pkt->pos);
+    }
+}
+
+bool AudioDecoder::decodeNext() {
+    if (!isOpen() || m_eof) return false;
+
+    while (true) {
+        if (cancelled()) return false;
+
+        int ret = avcodec_receive_frame(m_codec, m_frame);
+        if (ret == 0) {
+            convertFrame();
+            av_frame_unref(m_frame);
+            if (m_pendingPos < m_pending.size()) {
+                if (m_capture || m_diskWriter) capture(m_pending.data() + m_pendingPos, m_pending.size() - m_pendingPos);
+                return true;
+            }
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN) || m_draining) {
+            // Only a decode drained after the demuxer reached the real end
+            // of the file is complete enough to cache. A read error also
+            // ends the packet stream, but leaves the track truncated.
+            if (ret == AVERROR_EOF && m_reader.error() == AVERROR_EOF) {
+                finishCapture();
+                if (m_indexLive) {
+                    m_index.markComplete();
+                    if (m_seekTables) {
+                        double tb = av_q2d(m_fmt->streams[m_streamIdx]->time_base);
+                        m_seekTables->save(m_path, m_stamp, m_index,
+                                           static_cast<int64_t>(SEEK_TABLE_SPACING / tb));
+                    }
+                    m_indexLive = false;
+                }
+            } else {
+                dropCapture();
+            }
+            m_eof = true;
+            return false;
+        }
+
+        if (!m_reader.pop(m_packet)) {
+            if (cancelled()) return false;
+            avcodec_send_packet(m_codec, nullptr);
+            m_draining = true;
+            continue;
+        }
+        trackPacket(m_packet);
+        avcodec_send_packet(m_codec, m_packet);
+        av_packet_unref(m_packet);
+    }
+}
+
+void AudioDecoder::buildDownmix(const AVChannelLayout& layout) {
+    const int n = layout.nb_channels;
+    const float c = 0.7071f;
+    m_downmix.assign(static_cast<size_t>(n) * 2, 0.0f);
+
+    float sumL = 0.0f, sumR = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        float l = 0.0f, r = 0.0f;
+        switch (av_channel_layout_channel_from_index(&layout, i)) {
+        case AV_CHAN_FRONT_LEFT:     l = 1.0f; break;
+        case AV_CHAN_FRONT_RIGHT:    r = 1.0f; break;
+        case AV_CHAN_FRONT_CENTER:   l = r = c; break;
+        case AV_CHAN_LOW_FREQUENCY:  break;
+        case AV_CHAN_BACK_LEFT:
+        case AV_CHAN_SIDE_LEFT:      l = c; break;
+        case AV_CHAN_BACK_RIGHT:
+        case AV_CHAN_SIDE_RIGHT:     r = c; break;
+        default:                     l = r = 0.5f; break;
+        }
+        m_downmix[i] = l;
+        m_downmix[n + i] = r;
+        sumL += l;
+        sumR += r;
+    }
+
+    // Normalize so full-scale input on every channel cannot clip.
+    float peak = std::max(sumL, sumR);
+    if (peak > 1.0f)
+        for (float& g : m_downmix) g /= peak;
+}
+
+int AudioDecoder::convertDirect(float* out) {
+    const int channels = m_carrierChannels;
+    const size_t frames = static_cast<size_t>(m_frame->nb_samples);
+    const size_t samples = frames * channels;
+    uint8_t* const* data = m_frame->extended_data;
+
+    switch (m_frame->format) {
+    case AV_SAMPLE_FMT_FLT:
+        std::copy_n(reinterpret_cast<const float*>(data[0]), samples, out);
+        break;
+    case AV_SAMPLE_FMT_S16:
+        S16ToFloat(reinterpret_cast<const int16_t*>(data[0]), out, samples);
+        break;
+    case AV_SAMPLE_FMT_S32:
+        S32ToFloat(reinterpret_cast<const int32_t*>(data[0]), out, samples);
+        break;
+    case AV_SAMPLE_FMT_FLTP:
+        InterleaveFloat(reinterpret_cast<const float* const*>(data), channels, out, frames);
+        break;
+    case AV_SAMPLE_FMT_S16P:
+    case AV_SAMPLE_FMT_S32P: {
+        // Convert plane by plane, then interleave.
+        m_planar.resize(samples);
+        const float* planes[MAX_CHANNELS];
+        for (int c = 0; c < channels; ++c) {
+            float* plane = m_planar.data() + c * frames;
+            if (m_frame->format == AV_SAMPLE_FMT_S16P)
+                S16ToFloat(reinterpret_cast<const int16_t*>(data[c]), plane, frames);
+            else
+                S32ToFloat(reinterpret_cast<const int32_t*>(data[c]), plane, frames);
+            planes[c] = plane;
+        }
+        InterleaveFloat(planes, channels, out, frames);
+        break;
+    }
+    default:
+        return 0;
+    }
+    return m_frame->nb_samples;
+}
+
+void AudioDecoder::convertFrame() {
+    int out_samples = m_direct ? m_frame->nb_samples
+                               : swr_get_out_samples(m_swr, m_frame->nb_samples);
+    std::vector<float>& target = m_downmix.empty() ? m_pending : m_carrier;
+    target.resize(static_cast<size_t>(out_samples) * m_carrierChannels);
+    m_pendingPos = 0;
+
+    int converted;
+    if (m_direct) {
+        converted = convertDirect(target.data());
+    } else {
+        uint8_t* out_buffer = reinterpret_cast<uint8_t*>(target.data());
+        converted = swr_convert(
+            m_swr, &out_buffer, out_samples,
+            (const uint8_t**)m_frame->data, m_frame->nb_samples);
+    }
+    if (converted < 0) converted = 0;
+
+    m_pending.resize(static_cast<size_t>(converted) * m_channels);
+    if (!m_downmix.empty())
+        DownmixStereo(m_carrier.data(), m_carrierChannels, m_downmix.data(),
+                      m_pending.data(), static_cast<size_t>(converted));
+
+    // After a seek, drop the part of the first frames that lies before the target.
+    if (m_skipTo >= 0) {
+        int64_t pts = m_frame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE) {
+            int64_t start = av_rescale_q(pts - m_startPts,
+                                         m_fmt->streams[m_streamIdx]->time_base,
+                                         AVRational{1, m_sampleRate});
+            int64_t skip = m_skipTo - start;
+            if (skip > 0)
+                m_pendingPos = std::min(static_cast<size_t>(skip) * m_channels, m_pending.size());
+            if (skip < converted) m_skipTo = -1;
+        } else {
+            m_skipTo = -1;
+        }
+    }
+}
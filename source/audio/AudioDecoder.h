@@ -0,0 +1,175 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include "PacketReader.h"
+#include "PcmCache.h"
+#include "DiskPcmCache.h"
+#include "TrackPrefetch.h"
+#include "SeekTableStore.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswresample/swresample.h>
+}
+
+// Incremental FFmpeg decoder producing interleaved float32 frames in the
+// source's channel layout (stereo, quad, 5.1 or 7.1). Layouts with more
+// channels than the output allows are downmixed to stereo. Only the
+// packets needed for the requested frames are read, so memory use does
+// not depend on the track length. Packets are read ahead on a separate
+// thread (PacketReader) while the caller decodes.
+//
+// With a PcmCache or DiskPcmCache attached, tracks found in either are
+// served from memory (or a file mapping) without touching FFmpeg, and
+// tracks decoded start to end are added to them (the disk cache only for
+// codecs that are slow to decode). Files held by a
+// TrackPrefetch are demuxed from memory instead of being read from disk.
+//
+// Packet positions are indexed while decoding, so seeks back into the
+// decoded range jump straight to a nearby packet by byte offset and land
+// on the exact sample, instead of relying on the demuxer's estimate.
+// Complete indexes are kept in a SeekTableStore, so a track seen before
+// seeks that way from the moment it is opened.
+class AudioDecoder {
+public:
+    static constexpr int MAX_CHANNELS = 8;
+
+    AudioDecoder() = default;
+    ~AudioDecoder();
+
+    AudioDecoder(const AudioDecoder&) = delete;
+    AudioDecoder& operator=(const AudioDecoder&) = delete;
+
+    // Applies to tracks opened afterwards. 2 forces a stereo downmix.
+    void setMaxChannels(int channels) { m_maxChannels = channels; }
+
+    bool open(const std::string& path);
+    void close();
+
+    // Ties the decoder to a load generation: once `*generation` moves past
+    // `expected`, blocking I/O is interrupted and decoding stops at the
+    // next packet boundary.
+    void setGeneration(const std::atomic<uint32_t>* generation, uint32_t expected);
+    bool cancelled() const {
+        return m_generation &&
+               m_generation->load(std::memory_order_relaxed) != m_expected.load(std::memory_order_relaxed);
+    }
+
+    // Read-ahead limits and counters; applies to tracks opened afterwards.
+    void setReadAhead(PacketReader::Control* control) { m_readAhead = control; }
+    void setCache(PcmCache* cache) { m_cache = cache; }
+    void setDiskCache(DiskPcmCache* cache) { m_diskCache = cache; }
+    void setPrefetch(TrackPrefetch* prefetch) { m_prefetch = prefetch; }
+    void setSeekTables(SeekTableStore* store) { m_seekTables = store; }
+
+    // Writes up to `frames` frames into `out`, returns the number written.
+    // A short read means the end of the stream was reached or the load
+    // generation was cancelled.
+    size_t read(float* out, size_t frames);
+    bool seek(double seconds);
+
+    bool isOpen() const { return m_codec != nullptr || m_cachedData != nullptr; }
+    bool fromCache() const { return m_cachedData != nullptr; }
+    bool fromMemory() const { return m_image != nullptr; }
+    const SeekIndex& seekIndex() const { return m_index; }
+    bool eof() const { return m_eof; }
+    int sampleRate() const { return m_sampleRate; }
+    // Codec threads in use, including the caller's.
+    int codecThreads() const { return m_codec ? 1 + m_extraThreads : 0; }
+    int channels() const { return m_channels; }
+    double duration() const { return m_duration; }
+
+private:
+    static constexpr double SEEK_INDEX_SPACING = 0.25;
+    static constexpr double SEEK_PREROLL       = 0.1;
+    static constexpr double SEEK_TABLE_SPACING = 2.0;
+    static constexpr size_t CAPTURE_START_SECONDS = 10;
+
+    static int interruptCallback(void* opaque);
+    static int readImage(void* opaque, uint8_t* buf, int size);
+    static int64_t seekImage(void* opaque, int64_t offset, int whence);
+    bool decodeNext();
+    bool seekIndexed(int64_t ts);
+    void trackPacket(AVPacket* pkt);
+    void convertFrame();
+    int convertDirect(float* out);
+    void buildDownmix(const AVChannelLayout& layout);
+    size_t readCached(float* out, size_t frames);
+    void capture(const float* samples, size_t count);
+    void finishCapture();
+    void dropCapture();
+
+    AVFormatContext* m_fmt{nullptr};
+    AVCodecContext*  m_codec{nullptr};
+    SwrContext*      m_swr{nullptr};
+    bool             m_direct{false};
+    int              m_extraThreads{0};
+    AVPacket*        m_packet{nullptr};
+    AVFrame*         m_frame{nullptr};
+    int              m_streamIdx{-1};
+
+    const std::atomic<uint32_t>* m_generation{nullptr};
+    std::atomic<uint32_t>        m_expected{0};
+
+    PacketReader                 m_reader;
+    PacketReader::Control*       m_readAhead{nullptr};
+
+    int     m_maxChannels{2};
+    int     m_channels{0};
+    int     m_sampleRate{0};
+    double  m_duration{0.0};
+    int64_t m_startPts{0};
+    int64_t m_skipTo{-1};
+    bool    m_draining{false};
+    bool    m_eof{false};
+
+    // m_indexLive is cleared when a seek leaves the decoded range, since
+    // packets after it no longer continue the indexed run. After a byte
+    // seek, packets without timestamps are stamped from the index entry
+    // until the demuxer provides its own.
+    SeekTableStore* m_seekTables{nullptr};
+    std::string     m_path;
+    SeekIndex m_index;
+    bool      m_indexLive{false};
+    bool      m_byteSeek{false};
+    int64_t   m_restampPos{-1};
+    int64_t   m_restampPts{AV_NOPTS_VALUE};
+
+    // Carrier layout channels -> stereo, row-major by output channel.
+    std::vector<float>   m_downmix;
+    std::vector<float>   m_carrier;
+    std::vector<float>   m_planar;
+    int                  m_carrierChannels{0};
+
+    std::vector<float>   m_pending;
+    size_t               m_pendingPos{0};
+
+    bool openCached(const std::string& path);
+
+    PcmCache*                               m_cache{nullptr};
+    DiskPcmCache*                           m_diskCache{nullptr};
+    SourceStamp                             m_stamp;
+    std::string                             m_cacheKey;
+
+    // A cache hit: interleaved samples kept alive by m_cachedHold.
+    std::shared_ptr<const void>             m_cachedHold;
+    const float*                            m_cachedData{nullptr};
+    size_t                                  m_cachedSamples{0};
+    size_t                                  m_cachedPos{0};
+
+    std::shared_ptr<PcmCache::Track>        m_capture;
+    size_t                                  m_captureLimit{0};
+    size_t                                  m_captureExpected{0};
+    std::unique_ptr<DiskPcmCache::Writer>   m_diskWriter;
+
+    // A prefetched file and the I/O context reading from it.
+    TrackPrefetch*                              m_prefetch{nullptr};
+    std::shared_ptr<const TrackPrefetch::Image> m_image;
+    AVIOContext*                                m_avio{nullptr};
+    size_t                                      m_imagePos{0};
+};
@@ -1,9 +1,14 @@
 #include "AudioEngine.h"
+#include "OpenAlSink.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+#include <cstdlib>
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -13,289 +18,1258 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-static ALenum FormatFromChannels(int channels) {
-    if (channels == 1) return AL_FORMAT_MONO16;
-    if (channels == 2) return AL_FORMAT_STEREO16;
-    return AL_FORMAT_STEREO16;
+// Under the per-user cache directory, which unlike the temp directory is
+// not swept between runs: %LOCALAPPDATA%, or XDG_CACHE_HOME / ~/.cache.
+std::string AudioEngine::DefaultCachePath(const char* name) {
+    std::filesystem::path base;
+#ifdef _WIN32
+    if (const wchar_t* local = _wgetenv(L"LOCALAPPDATA"); local && *local)
+        base = std::filesystem::path(local) / "Vesper" / "Cache";
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        base = std::filesystem::path(xdg) / "vesper";
+    else if (const char* home = std::getenv("HOME"); home && *home)
+        base = std::filesystem::path(home) / ".cache" / "vesper";
+#endif
+    if (base.empty()) {
+        std::error_code ec;
+        base = std::filesystem::temp_directory_path(ec);
+        if (ec) return {};
+        base /= "Vesper";
+    }
+    return (base / name).u8string();
 }
 
-AudioEngine::AudioEngine() : m_fft(FFT_SIZE, false), m_running(true) {
-    av_log_set_level(AV_LOG_ERROR);
+static int64_t NowNs() {
+    return PlaybackClock::nowNs();
+}
 
-    m_device = alcOpenDevice(nullptr);
-    if (!m_device) {
-        throw std::runtime_error("OpenAL: Failed to open device");
-    }
+AudioEngine::AudioEngine(std::unique_ptr<AudioSink> sink)
+    : m_sink(sink ? std::move(sink) : std::make_unique<OpenAlSink>()),
+      m_running(true), m_fft(FFT_SIZE, false) {
+    av_log_set_level(AV_LOG_ERROR);
 
-    m_context = alcCreateContext(m_device, nullptr);
-    if (!m_context || !alcMakeContextCurrent(m_context)) {
-        alcCloseDevice(m_device);
-        throw std::runtime_error("OpenAL: Failed to create or set context");
+    for (int i = 0; i < MAX_BUFFERS; ++i) {
+        m_buffers[i].pcm.reserve(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+        m_free.push_back(i);
     }
-
-    alGenSources(1, &m_source);
-    alGenBuffers(1, &m_buffer);
+    for (auto& block : m_ring.slots())
+        block.samples.resize(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+    m_fadeSamples.resize(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+    m_stretchOut.reserve(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+    m_output.resize(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+    m_pcm16.resize(BUFFER_FRAMES * AudioDecoder::MAX_CHANNELS);
+    m_outputStats.buffers = m_bufferCount;
+    m_outputStats.bufferFrames = m_bufferFrames;
+    m_fadeOutGain.resize(BUFFER_FRAMES);
+    m_fadeInGain.resize(BUFFER_FRAMES);
+    m_stretch.configure(MAX_SAMPLE_RATE, AudioDecoder::MAX_CHANNELS, BUFFER_FRAMES);
+    m_limiter.configure(MAX_SAMPLE_RATE, AudioDecoder::MAX_CHANNELS, BUFFER_FRAMES);
     
+    m_fftIn.resize(FFT_SIZE);
+    m_fftOut.resize(FFT_SIZE);
+    m_bins.resize(64);
     m_window.resize(FFT_SIZE);
     for (size_t i = 0; i < FFT_SIZE; ++i) {
         m_window[i] = 0.5f * (1.0f - std::cos(
             2.0f * static_cast<float>(M_PI) * i / (FFT_SIZE - 1)));
     }
-    
-    m_thread = std::thread(&AudioEngine::workerThread, this);
+
+    // The device is opened on the engine thread; failures are rethrown here.
+    std::promise<void> started;
+    std::future<void> result = started.get_future();
+    m_thread = std::thread(&AudioEngine::engineThread, this, std::move(started));
+    try {
+        result.get();
+    } catch (...) {
+        m_thread.join();
+        throw;
+    }
+
+    // Sinks without surround output get stereo downmixes.
+    int maxChannels = std::min(m_sink->maxChannels(), AudioDecoder::MAX_CHANNELS);
+    m_decoder->setMaxChannels(maxChannels);
+    m_nextDecoder->setMaxChannels(maxChannels);
+    m_fadeDecoder->setMaxChannels(maxChannels);
+    m_decoder->setReadAhead(&m_readAhead);
+    m_nextDecoder->setReadAhead(&m_readAhead);
+    m_fadeDecoder->setReadAhead(&m_readAhead);
+    m_decoder->setCache(&m_pcmCache);
+    m_nextDecoder->setCache(&m_pcmCache);
+    m_fadeDecoder->setCache(&m_pcmCache);
+    m_decoder->setDiskCache(&m_diskCache);
+    m_nextDecoder->setDiskCache(&m_diskCache);
+    m_fadeDecoder->setDiskCache(&m_diskCache);
+    m_decoder->setPrefetch(&m_prefetch);
+    m_nextDecoder->setPrefetch(&m_prefetch);
+    m_fadeDecoder->setPrefetch(&m_prefetch);
+    m_decoder->setSeekTables(&m_seekTables);
+    m_nextDecoder->setSeekTables(&m_seekTables);
+    m_fadeDecoder->setSeekTables(&m_seekTables);
+
+    m_decodeThread = std::thread(&AudioEngine::decodeThread, this);
 }
 
 AudioEngine::~AudioEngine() {
-    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_running = false;
+    }
+    m_requestCv.notify_all();
+    wakeOutput();
+    if (m_decodeThread.joinable()) m_decodeThread.join();
     if (m_thread.joinable()) m_thread.join();
 
-    stop();
+    m_decoder->close();
+    m_nextDecoder->close();
+    m_fadeDecoder->close();
+}
 
-    alDeleteSources(1, &m_source);
-    alDeleteBuffers(1, &m_buffer);
+void AudioEngine::openDevice() {
+    m_sink->open(MAX_BUFFERS, [this] { wakeOutput(); });
+    m_limiter.setGain(m_volume.load(), true);
+    m_floatOutput = m_sink->floatOutput();
+}
 
-    alcMakeContextCurrent(nullptr);
-    if (m_context) alcDestroyContext(m_context);
-    if (m_device) alcCloseDevice(m_device);
+void AudioEngine::closeDevice() {
+    resetQueue();
+    m_sink->close();
 }
 
 void AudioEngine::loadAndPlay(const std::string& filePath) {
-    std::lock_guard<std::mutex> lock(m_trackMutex);
-
-    alSourceStop(m_source);
-    m_playing = false;
-    m_position.store(0.0);
-
-    alSourcei(m_source, AL_BUFFER, 0);
-    if (m_buffer != 0) {
-        alDeleteBuffers(1, &m_buffer);
-        m_buffer = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_currentFile = filePath;
     }
-
-    if (!decodeFile(filePath)) {
-        std::cerr << "Failed to load audio: " << filePath << "\n";
-        m_currentFile.clear();
-        m_duration.store(0.0);
-        return;
-    }
-    
-    alSourcei(m_source, AL_BUFFER, m_buffer);
-    alSourcef(m_source, AL_GAIN, m_volume.load());
-
-    alSourcePlay(m_source);
-    m_playing = true;
-    m_currentFile = filePath;
+    m_clock.reset(0.0, 0);
+    m_timeToFirstAudio.store(-1.0);
+    m_loadStartNs.store(NowNs());
+    requestDecode(filePath, 0.0);
+    post(CommandType::Play);
 }
 
 void AudioEngine::play() {
-    if (m_buffer != 0) {
-        alSourcePlay(m_source);
-        m_playing = true;
-    }
+    post(CommandType::Play);
 }
 
 void AudioEngine::pause() {
-    if (m_buffer != 0) {
-        alSourcePause(m_source);
-        m_playing = false;
-    }
+    post(CommandType::Pause);
 }
 
 void AudioEngine::playPause() {
-    ALint state;
-    alGetSourcei(m_source, AL_SOURCE_STATE, &state);
-    if (state == AL_PLAYING)
-        pause();
-    else
-        play();
+    post(CommandType::PlayPause);
 }
 
 void AudioEngine::stop() {
-    if (m_buffer != 0) {
-        alSourceStop(m_source);
-        m_playing = false;
-        m_position.store(0.0);
-    }
+    m_clock.reset(0.0, m_clock.now().sampleRate);
+    post(CommandType::Stop);
+    requestDecode(currentFile(), 0.0);
 }
 
 void AudioEngine::seek(double seconds) {
     if (seconds < 0) seconds = 0;
     if (seconds > m_duration.load()) seconds = m_duration.load();
 
-    ALint state;
-    alGetSourcei(m_source, AL_SOURCE_STATE, &state);
-    if (state == AL_PLAYING || state == AL_PAUSED)
-        alSourcef(m_source, AL_SEC_OFFSET, static_cast<float>(seconds));
-
-    m_position.store(seconds);
+    m_seekSerial.store(requestDecode(currentFile(), seconds));
+    m_clock.reset(seconds, m_clock.now().sampleRate);
 }
 
 void AudioEngine::setVolume(float v) {
     v = std::clamp(v, 0.0f, 2.0f);
     m_volume.store(v);
-    alSourcef(m_source, AL_GAIN, v);
+    post(CommandType::SetVolume, v);
+}
+
+void AudioEngine::setRealtime(bool enabled) {
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_realtime.store(enabled);
+    }
+    m_requestCv.notify_one();
+    wakeOutput();
+}
+
+AudioEngine::RealtimeStatus AudioEngine::realtimeStatus() const {
+    std::lock_guard<std::mutex> lock(m_realtimeMutex);
+    return m_realtimeStatus;
+}
+
+void AudioEngine::applyOutputRealtime(bool enabled) {
+    m_outputRealtime = enabled;
+    if (enabled) {
+        m_outputGrant = RaiseCurrentThread(ThreadPriorityLevel::Realtime);
+
+        // Everything the output path touches while playing. These buffers
+        // are sized up front and never reallocate.
+        bool locked = true;
+        for (auto& block : m_ring.slots())
+            locked &= m_memoryLock.add(block.samples.data(), block.samples.capacity() * sizeof(float));
+        for (auto& buf : m_buffers)
+            locked &= m_memoryLock.add(buf.pcm.data(), buf.pcm.capacity() * sizeof(float));
+        locked &= m_memoryLock.add(m_stretchOut.data(), m_stretchOut.capacity() * sizeof(float));
+        locked &= m_memoryLock.add(m_output.data(), m_output.capacity() * sizeof(float));
+        locked &= m_memoryLock.add(m_pcm16.data(), m_pcm16.capacity() * sizeof(int16_t));
+        locked &= m_stretch.lockMemory(m_memoryLock);
+        locked &= m_limiter.lockMemory(m_memoryLock);
+        // The crossfade mix runs on the decode thread, but feeds the ring.
+        locked &= m_memoryLock.add(m_fadeSamples.data(), m_fadeSamples.capacity() * sizeof(float));
+        locked &= m_memoryLock.add(m_fadeOutGain.data(), m_fadeOutGain.capacity() * sizeof(float));
+        locked &= m_memoryLock.add(m_fadeInGain.data(), m_fadeInGain.capacity() * sizeof(float));
+
+        if (m_outputGrant.level != ThreadPriorityLevel::Realtime)
+            std::cerr << "Real-time scheduling unavailable, output thread is "
+                      << ThreadPriorityName(m_outputGrant.level) << "\n";
+        if (!locked)
+            std::cerr << "Could not lock all audio buffers in memory\n";
+
+        std::lock_guard<std::mutex> lock(m_realtimeMutex);
+        m_realtimeStatus.memoryLocked = locked;
+    } else {
+        RestoreCurrentThread(m_outputGrant);
+        m_memoryLock.release();
+
+        std::lock_guard<std::mutex> lock(m_realtimeMutex);
+        m_realtimeStatus.memoryLocked = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_realtimeMutex);
+    m_realtimeStatus.requested = enabled;
+    m_realtimeStatus.output = m_outputGrant.level;
+    m_realtimeStatus.outputMethod = m_outputGrant.method;
+    m_realtimeStatus.lockedBytes = m_memoryLock.bytes();
+}
+
+void AudioEngine::applyDecodeRealtime(bool enabled) {
+    // The decode thread runs well ahead of playback, so it only needs to
+    // win against ordinary load, not to preempt it.
+    m_decodeRealtime = enabled;
+    if (enabled)
+        m_decodeGrant = RaiseCurrentThread(ThreadPriorityLevel::Raised);
+    else
+        RestoreCurrentThread(m_decodeGrant);
+
+    std::lock_guard<std::mutex> lock(m_realtimeMutex);
+    m_realtimeStatus.decode = m_decodeGrant.level;
+    m_realtimeStatus.decodeMethod = m_decodeGrant.method;
+}
+
+void AudioEngine::setOutputBufferBounds(int minBuffers, int maxBuffers,
+                                        size_t minFrames, size_t maxFrames,
+                                        double maxLatency) {
+    minBuffers = std::clamp(minBuffers, 2, MAX_BUFFERS);
+    maxBuffers = std::clamp(maxBuffers, minBuffers, MAX_BUFFERS);
+    minFrames = std::clamp(minFrames, MIN_BUFFER_FRAMES, BUFFER_FRAMES);
+    maxFrames = std::clamp(maxFrames, minFrames, BUFFER_FRAMES);
+    m_minBuffers.store(minBuffers);
+    m_maxBuffers.store(maxBuffers);
+    m_minBufferFrames.store(minFrames);
+    m_maxBufferFrames.store(maxFrames);
+    m_maxLatency.store(std::max(maxLatency, 0.0));
+    wakeOutput();
+}
+
+AudioEngine::OutputBufferStats AudioEngine::outputBufferStats() const {
+    std::lock_guard<std::mutex> lock(m_outputStatsMutex);
+    OutputBufferStats stats = m_outputStats;
+    stats.history.assign(m_bufferHistory.begin(), m_bufferHistory.end());
+    return stats;
+}
+
+void AudioEngine::setSpeed(double speed) {
+    m_speed.store(std::clamp(speed, TimeStretch::MIN_SPEED, TimeStretch::MAX_SPEED));
+}
+
+void AudioEngine::post(CommandType type, float value) {
+    if (!m_commands.push({type, value, NowNs()}))
+        std::cerr << "Audio command queue full, command dropped\n";
+    wakeOutput();
+}
+
+void AudioEngine::wakeOutput() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakePending = true;
+    }
+    m_outputCv.notify_one();
+}
+
+void AudioEngine::processCommands() {
+    Command cmd;
+    while (m_commands.pop(cmd)) {
+        // A command posted after a decode request must not act on the
+        // queue of the request it replaced.
+        syncSerial();
+
+        switch (cmd.type) {
+        case CommandType::Play:
+            m_playing = true;
+            if (readyToStart()) startSource();
+            break;
+        case CommandType::Pause:
+            m_playing = false;
+            m_sink->pause();
+            break;
+        case CommandType::PlayPause:
+            m_playing = !m_playing;
+            if (!m_playing)
+                m_sink->pause();
+            else if (readyToStart())
+                startSource();
+            break;
+        case CommandType::Stop:
+            m_playing = false;
+            m_sourceStarted = false;
+            m_sink->stop();
+            break;
+        case CommandType::SetVolume:
+            m_limiter.setGain(cmd.value);
+            break;
+        }
+
+        int64_t latency = NowNs() - cmd.postedNs;
+        m_commandCount.fetch_add(1);
+        m_commandTotalNs.fetch_add(latency);
+        m_commandLastNs.store(latency);
+        if (latency > m_commandMaxNs.load()) m_commandMaxNs.store(latency);
+    }
+}
+
+AudioEngine::CommandStats AudioEngine::commandStats() const {
+    CommandStats stats;
+    stats.count = m_commandCount.load();
+    stats.lastMs = m_commandLastNs.load() / 1e6;
+    stats.maxMs = m_commandMaxNs.load() / 1e6;
+    stats.avgMs = stats.count ? m_commandTotalNs.load() / 1e6 / stats.count : 0.0;
+    return stats;
+}
+
+void AudioEngine::setReadAhead(size_t maxBytes, double maxSeconds) {
+    m_readAhead.maxBytes.store(std::max<size_t>(maxBytes, 1));
+    m_readAhead.maxSeconds.store(std::max(maxSeconds, 0.0));
+}
+
+AudioEngine::ReadAheadStats AudioEngine::readAheadStats() const {
+    ReadAheadStats stats;
+    stats.maxBytes = m_readAhead.maxBytes.load();
+    stats.maxSeconds = m_readAhead.maxSeconds.load();
+    stats.packets = m_readAhead.packets.load();
+    stats.bytes = m_readAhead.bytes.load();
+    stats.readStalls = m_readAhead.readStalls.load();
+    stats.decodeStalls = m_readAhead.decodeStalls.load();
+    return stats;
+}
+
+void AudioEngine::setNextTrack(const std::string& filePath) {
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        if (m_nextFile == filePath && m_nextAfter == m_currentFile) return;
+        m_nextFile = filePath;
+        m_nextAfter = m_currentFile;
+    }
+    m_requestCv.notify_one();
+}
+
+void AudioEngine::setRepeat(bool repeat) {
+    {
+        // The decode thread reads repeat inside its wait predicate.
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_repeat.store(repeat);
+    }
+    m_requestCv.notify_one();
+}
+
+void AudioEngine::setShuffle(bool shuffle) {
+    m_shuffle.store(shuffle);
+}
+
+bool AudioEngine::pollEvent(AudioEvent& event) {
+    std::lock_guard<std::mutex> lock(m_eventMutex);
+    while (!m_events.empty()) {
+        event = std::move(m_events.front());
+        m_events.pop_front();
+        // A track start that was overtaken by a newer request is stale.
+        if (event.type == AudioEventType::TrackStarted && event.serial != m_serial.load())
+            continue;
+        return true;
+    }
+    return false;
+}
+
+void AudioEngine::pushEvent(AudioEventType type, const std::string& file, double position) {
+    std::lock_guard<std::mutex> lock(m_eventMutex);
+    if (m_events.size() >= MAX_EVENTS) m_events.pop_front();
+    m_events.push_back({type, m_outputSerial, file, position});
+}
+
+void AudioEngine::setCrossfade(double seconds, FadeCurve curve) {
+    m_crossfadeSeconds.store(std::clamp(seconds, 0.0, MAX_CROSSFADE));
+    m_crossfadeCurve.store(curve);
+}
+
+std::string AudioEngine::nextFile() const {
+    std::lock_guard<std::mutex> lock(m_requestMutex);
+    return nextFileLocked();
+}
+
+const std::string& AudioEngine::nextFileLocked() const {
+    static const std::string none;
+    // The next entry only applies to the track it was queued after, so a
+    // stale entry is never spliced onto the track that replaced it.
+    if (m_repeat) return m_decodeFile;
+    return m_nextAfter == m_decodeFile ? m_nextFile : none;
 }
 
 std::string AudioEngine::currentFile() const {
+    std::lock_guard<std::mutex> lock(m_requestMutex);
     return m_currentFile;
 }
 
 std::optional<AudioMetadata> AudioEngine::currentMetadata() const {
-    if (m_currentFile.empty()) return std::nullopt;
-    auto map = AddAudioFile(m_currentFile);
-    auto it = map.find(m_currentFile);
+    std::string file = currentFile();
+    if (file.empty()) return std::nullopt;
+    auto map = AddAudioFile(file);
+    auto it = map.find(file);
     if (it != map.end()) return it->second;
     return std::nullopt;
 }
 
-void AudioEngine::workerThread() {
+uint32_t AudioEngine::requestDecode(const std::string& file, double seconds) {
+    if (file.empty()) return 0;
+    uint32_t serial;
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        m_pendingFile = file;
+        m_pendingSeek = seconds;
+        m_needNewTrack = true;
+        serial = m_serial.fetch_add(1) + 1;
+    }
+    m_requestCv.notify_one();
+    wakeOutput();
+    return serial;
+}
+
+void AudioEngine::decodeThread() {
+    uint32_t serial = 0;
+    // Kept across iterations so their storage is reused.
+    std::string file;
+    std::string next;
+
     while (m_running) {
-        ALint state = 0;
-        alGetSourcei(m_source, AL_SOURCE_STATE, &state);
+        file.clear();
+        double seekTo = 0.0;
+        bool newRequest = false;
+        {
+            std::unique_lock<std::mutex> lock(m_requestMutex);
+            bool hasData = m_decoder->isOpen() &&
+                           (!m_decoder->eof() || m_headPos < m_head.size());
+            auto ready = [&] {
+                if (!m_running || m_needNewTrack) return true;
+                if (m_realtime.load() != m_decodeRealtime) return true;
+                if (hasData) return m_ring.size() < m_ring.capacity();
+                return m_decoder->isOpen() && !nextFileLocked().empty();
+            };
+            // The output stage signals freed ring slots without taking the
+            // lock, so a wakeup can be missed; the timeout covers that case.
+            if (hasData)
+                m_requestCv.wait_for(lock, std::chrono::milliseconds(100), ready);
+            else
+                m_requestCv.wait(lock, ready);
 
-        if (state == AL_PLAYING) {
-            float offset = 0.0f;
-            alGetSourcef(m_source, AL_SEC_OFFSET, &offset);
-            m_position.store(static_cast<double>(offset));
+            if (!m_running) break;
+            if (m_needNewTrack) {
+                file.swap(m_pendingFile);
+                seekTo = m_pendingSeek;
+                serial = m_serial.load();
+                m_needNewTrack = false;
+                newRequest = true;
+            }
+            next = nextFileLocked();
+        }
 
-            if (m_spectrumCb && !m_pcm.empty() && m_sampleRate > 0) {
-                int64_t sampleIndex = static_cast<int64_t>(offset * m_sampleRate) * 2;
+        if (m_realtime.load() != m_decodeRealtime)
+            applyDecodeRealtime(!m_decodeRealtime);
 
-                if (sampleIndex + FFT_SIZE * 2 <= static_cast<int64_t>(m_pcm.size())) {
-                    updateSpectrum(m_pcm.data() + sampleIndex);
+        if (newRequest) {
+            // Work for older requests stops at its next packet or I/O wait.
+            m_decoder->setGeneration(&m_serial, serial);
+            m_nextDecoder->setGeneration(&m_serial, serial);
+            m_fadeDecoder->setGeneration(&m_serial, serial);
+            m_fadeDecoder->close();
+
+            bool ok = true;
+            if (file != m_decodeFile || !m_decoder->isOpen() || seekTo <= 0.0)
+                ok = openTrack(file);
+            if (ok && seekTo > 0.0) {
+                if (m_decoder->seek(seekTo)) {
+                    m_decodeFrame = std::llround(seekTo * m_decoder->sampleRate());
+                } else {
+                    // Where the demuxer stopped is unknown; start the track
+                    // over so m_decodeFrame matches what is decoded.
+                    std::cerr << "Seek failed, restarting: " << file << "\n";
+                    ok = openTrack(file);
                 }
             }
-        } else if (state != AL_PAUSED) {
-            m_playing = false;
+
+            if (!ok && m_needNewTrack) continue;
+            if (!ok) {
+                std::cerr << "Failed to load audio: " << file << "\n";
+                {
+                    std::lock_guard<std::mutex> lock(m_requestMutex);
+                    if (serial == m_serial.load()) m_currentFile.clear();
+                }
+                m_duration.store(0.0);
+                m_eofSerial.store(serial);
+                wakeOutput();
+                continue;
+            }
+        }
+
+        if (!m_decoder->isOpen()) continue;
+
+        while (m_running && !m_needNewTrack && decodeBlock(serial)) {}
+
+        if (m_needNewTrack) continue;
+        if (m_decoder->eof() && m_headPos >= m_head.size()) {
+            m_eofSerial.store(serial);
+            wakeOutput();
+            continue;
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(120));
+        // The ring is full: use the idle time to pre-roll the next track
+        // once the current one is close to its end.
+        double remaining = m_decoder->duration() -
+                           static_cast<double>(m_decodeFrame) / m_decoder->sampleRate();
+        if (!next.empty() && next != m_prerollFile &&
+            m_decoder->duration() > 0.0 && remaining < PREROLL_LEAD)
+            prerollNext(next);
     }
 }
 
-bool AudioEngine::decodeFile(const std::string& path) {
-    m_pcm.clear();
+bool AudioEngine::decodeBlock(uint32_t serial) {
+    PcmBlock* block = m_ring.writeSlot();
+    if (!block) return false;
+
+    // Start the crossfade once the current track is within the fade length
+    // of its end, as estimated from the container duration.
+    double fadeSeconds = m_crossfadeSeconds.load();
+    if (fadeSeconds > 0.0 && !m_fadeDecoder->isOpen() && m_headPos >= m_head.size()) {
+        int rate = m_decoder->sampleRate();
+        int64_t remaining = std::llround(m_decoder->duration() * rate) - m_decodeFrame;
+        if (m_decoder->duration() > 0.0 && remaining <= std::llround(fadeSeconds * rate)) {
+            std::string next = nextFile();
+            if (!next.empty())
+                startCrossfade(next, std::max<int64_t>(remaining, 1));
+        }
+    }
+
+    size_t frames = readFrames(block->samples.data(), BUFFER_FRAMES);
+    if (m_fadeDecoder->isOpen())
+        frames = mixCrossfade(block->samples.data(), frames);
+    if (frames == 0) {
+        if (m_needNewTrack) return false;
+
+        // Tracks are spliced on block boundaries; the AL queue plays
+        // consecutive buffers back to back, so no silence is inserted.
+        if (!spliceNext()) return false;
+        frames = readFrames(block->samples.data(), BUFFER_FRAMES);
+        if (frames == 0) return false;
+    }
+
+    block->serial = serial;
+    block->track = m_decodeTrack;
+    block->sampleRate = m_decoder->sampleRate();
+    block->channels = m_decoder->channels();
+    block->startFrame = m_decodeFrame;
+    block->frames = frames;
+    m_decodeFrame += static_cast<int64_t>(frames);
+
+    m_ring.commitWrite();
+    wakeOutput();
+    return true;
+}
 
-    AVFormatContext* fmt_ctx = nullptr;
-    if (avformat_open_input(&fmt_ctx, path.c_str(), nullptr, nullptr) < 0) {
-        std::cerr << "Failed to open file: " << path << std::endl;
+size_t AudioEngine::readFrames(float* out, size_t frames) {
+    const size_t channels = m_decoder->channels();
+    size_t written = 0;
+    if (m_headPos < m_head.size()) {
+        written = std::min(frames, (m_head.size() - m_headPos) / channels);
+        std::copy_n(m_head.data() + m_headPos, written * channels, out);
+        m_headPos += written * channels;
+    }
+    return written + m_decoder->read(out + written * channels, frames - written);
+}
+
+bool AudioEngine::startCrossfade(const std::string& file, int64_t length) {
+    if (file != m_prerollFile) prerollNext(file);
+    if (!m_nextDecoder->isOpen() ||
+        m_nextDecoder->sampleRate() != m_decoder->sampleRate() ||
+        m_nextDecoder->channels() != m_decoder->channels())
+        return false;
+
+    std::swap(m_fadeDecoder, m_decoder);
+    m_fadeLength = length;
+    m_fadePos = 0;
+    return openTrack(file);
+}
+
+size_t AudioEngine::mixCrossfade(float* out, size_t frames) {
+    const int channels = m_decoder->channels();
+
+    // Both decoders run during the overlap; whichever comes up short is
+    // padded with silence so the fade stays sample-aligned.
+    size_t outgoing = m_fadeDecoder->read(m_fadeSamples.data(), BUFFER_FRAMES);
+    size_t total = std::max(frames, outgoing);
+    if (frames < total)
+        std::fill(out + frames * channels, out + total * channels, 0.0f);
+    if (outgoing < total)
+        std::fill(m_fadeSamples.begin() + outgoing * channels,
+                  m_fadeSamples.begin() + total * channels, 0.0f);
+
+    FadeGains(m_crossfadeCurve.load(), m_fadePos, m_fadeLength, total,
+              m_fadeOutGain.data(), m_fadeInGain.data());
+    MixCrossfade(m_fadeSamples.data(), out, m_fadeOutGain.data(), m_fadeInGain.data(),
+                 out, total, channels);
+
+    m_fadePos += static_cast<int64_t>(total);
+    if (m_fadePos >= m_fadeLength || total == 0)
+        m_fadeDecoder->close();
+    return total;
+}
+
+bool AudioEngine::openTrack(const std::string& file) {
+    m_head.clear();
+    m_headPos = 0;
+
+    if (file == m_prerollFile && m_nextDecoder->isOpen()) {
+        std::swap(m_decoder, m_nextDecoder);
+        m_head.swap(m_preroll);
+    } else if (!m_decoder->open(file)) {
+        m_decodeFile.clear();
         return false;
     }
 
-    if (avformat_find_stream_info(fmt_ctx, nullptr) < 0) {
-        avformat_close_input(&fmt_ctx);
+    m_nextDecoder->close();
+    m_preroll.clear();
+    m_prerollFile.clear();
+
+    beginTrack(file);
+    return true;
+}
+
+bool AudioEngine::prerollNext(const std::string& file) {
+    m_preroll.clear();
+    m_prerollFile = file;
+
+    if (!m_nextDecoder->open(file)) {
+        if (m_nextDecoder->cancelled())
+            m_prerollFile.clear();
+        else
+            std::cerr << "Failed to pre-roll audio: " << file << "\n";
+        m_nextDecoder->close();
         return false;
     }
 
-    int stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
-    if (stream_idx < 0) {
-        avformat_close_input(&fmt_ctx);
+    size_t frames = static_cast<size_t>(PREROLL_SECONDS * m_nextDecoder->sampleRate());
+    m_preroll.resize(frames * m_nextDecoder->channels());
+    frames = m_nextDecoder->read(m_preroll.data(), frames);
+    m_preroll.resize(frames * m_nextDecoder->channels());
+
+    if (m_nextDecoder->cancelled()) {
+        m_nextDecoder->close();
+        m_preroll.clear();
+        m_prerollFile.clear();
         return false;
     }
+    return true;
+}
 
-    AVStream* audio_stream = fmt_ctx->streams[stream_idx];
-    const AVCodec* codec = avcodec_find_decoder(audio_stream->codecpar->codec_id);
+bool AudioEngine::spliceNext() {
+    std::string next = nextFile();
+    if (next.empty()) return false;
 
-    AVCodecContext* codec_ctx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_ctx, audio_stream->codecpar);
+    if (next != m_prerollFile) prerollNext(next);
+    if (!m_nextDecoder->isOpen()) return false;
 
-    if (avcodec_open2(codec_ctx, codec, nullptr) < 0) {
-        avcodec_free_context(&codec_ctx);
-        avformat_close_input(&fmt_ctx);
-        return false;
+    m_eofSerial.store(0);
+    return openTrack(next);
+}
+
+void AudioEngine::beginTrack(const std::string& file) {
+    m_decodeFile = file;
+    m_decodeFrame = 0;
+    ++m_decodeTrack;
+
+    std::lock_guard<std::mutex> lock(m_requestMutex);
+    m_tracks.push_back({m_decodeTrack, file, m_decoder->duration()});
+    while (m_tracks.size() > 8) m_tracks.pop_front();
+}
+
+void AudioEngine::updatePlayingTrack() {
+    if (m_queued.empty()) return;
+
+    uint32_t track = m_buffers[m_queued.front()].track;
+    if (track == m_playingTrack) return;
+
+    std::string ended;
+    std::string started;
+    {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        if (m_outputSerial != m_serial.load()) return;
+
+        // A new head track within the same request was spliced on, so the
+        // previous one played to its end.
+        if (m_playingSerial == m_outputSerial) ended = m_currentFile;
+        m_playingTrack = track;
+        m_playingSerial = m_outputSerial;
+
+        for (const auto& info : m_tracks) {
+            if (info.track != track) continue;
+            m_currentFile = info.file;
+            m_duration.store(info.duration);
+            break;
+        }
+        started = m_currentFile;
     }
 
-    SwrContext* swr = swr_alloc();
-    av_opt_set_chlayout(swr, "in_chlayout", &codec_ctx->ch_layout, 0);
-    av_opt_set_int(swr, "in_sample_rate", codec_ctx->sample_rate, 0);
-    av_opt_set_sample_fmt(swr, "in_sample_fmt", codec_ctx->sample_fmt, 0);
+    if (!ended.empty()) pushEvent(AudioEventType::TrackEnded, ended, m_duration.load());
+    pushEvent(AudioEventType::TrackStarted, started, 0.0);
+}
+
+void AudioEngine::engineThread(std::promise<void> started) {
+    try {
+        openDevice();
+    } catch (...) {
+        started.set_exception(std::current_exception());
+        return;
+    }
+    started.set_value();
 
-    AVChannelLayout out_layout = {};
-    av_channel_layout_default(&out_layout, 2);
-    av_opt_set_chlayout(swr, "out_chlayout", &out_layout, 0);
-    av_opt_set_int(swr, "out_sample_rate", codec_ctx->sample_rate, 0);
-    av_opt_set_sample_fmt(swr, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+    while (m_running) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_outputCv.wait_for(lock, nextWakeup(), [this] {
+                return m_wakePending.exchange(false) || !m_running;
+            });
+        }
+        if (!m_running) break;
 
-    swr_init(swr);
-    m_sampleRate = codec_ctx->sample_rate;
+        if (m_realtime.load() != m_outputRealtime)
+            applyOutputRealtime(!m_outputRealtime);
 
-    AVPacket* packet = av_packet_alloc();
-    AVFrame* frame = av_frame_alloc();
+        syncSerial();
+        reclaimBuffers();
+        fillQueue();
+        updatePlayingTrack();
+        processCommands();
 
-    while (av_read_frame(fmt_ctx, packet) >= 0) {
-        if (packet->stream_index == stream_idx) {
-            if (avcodec_send_packet(codec_ctx, packet) == 0) {
-                while (avcodec_receive_frame(codec_ctx, frame) == 0) {
-                    int out_samples = swr_get_out_samples(swr, frame->nb_samples);
-                    uint8_t* out_buffer = nullptr;
-                    int out_linesize = 0;
-                    av_samples_alloc(&out_buffer, &out_linesize, 2,
-                                     out_samples, AV_SAMPLE_FMT_S16, 0);
+        AudioSink::State state = m_sink->state();
+        adaptBuffers(state == AudioSink::State::Playing);
 
-                    int converted = swr_convert(
-                        swr, &out_buffer, out_samples,
-                        (const uint8_t**)frame->data, frame->nb_samples);
+        if (m_outputSerial == m_serial.load())
+            publishClock(state);
 
-                    int data_size = av_samples_get_buffer_size(
-                        nullptr, 2, converted, AV_SAMPLE_FMT_S16, 1);
+        if (state == AudioSink::State::Playing) {
+            if (m_outputSerial != m_serial.load()) continue;
 
-                    m_pcm.insert(
-                        m_pcm.end(),
-                        (int16_t*)out_buffer,
-                        (int16_t*)(out_buffer + data_size)
-                    );
+            int64_t frame = playbackFrame();
+            if (m_spectrumCb) {
+                for (int slot : m_queued) {
+                    const StreamBuffer& buf = m_buffers[slot];
+                    int64_t offset = std::llround((frame - buf.startFrame) / buf.speed);
+                    int64_t frames = static_cast<int64_t>(buf.frames());
+                    if (offset < 0 || offset >= frames) continue;
+                    if (offset + static_cast<int64_t>(FFT_SIZE) <= frames)
+                        updateSpectrum(buf.pcm.data() + offset * buf.channels, buf.channels);
+                    break;
+                }
+            }
+        } else if (m_playing) {
+            bool finished = m_queued.empty() && m_ring.empty() &&
+                            m_eofSerial.load() == m_outputSerial;
 
-                    av_freep(&out_buffer);
+            // A started source that stopped on its own either played the
+            // last buffer of the stream or ran dry before it was refilled.
+            if (m_sourceStarted && state == AudioSink::State::Stopped) {
+                m_sourceStarted = false;
+                // A sink that is not paced runs dry whenever decoding
+                // falls behind it, which nobody hears.
+                if (!finished && m_sink->paced()) {
+                    m_underruns.fetch_add(1);
+                    noteBufferEvent(OutputBufferEvent::Kind::Underrun);
+                    pushEvent(AudioEventType::BufferUnderrun, currentFile(), m_clock.now().seconds);
                 }
             }
+
+            if (readyToStart()) {
+                startSource();
+            } else if (finished) {
+                m_playing = false;
+                pushEvent(AudioEventType::TrackEnded, currentFile(), m_duration.load());
+            }
+        }
+    }
+
+    if (m_outputRealtime) applyOutputRealtime(false);
+    closeDevice();
+}
+
+std::chrono::microseconds AudioEngine::nextWakeup() const {
+    using std::chrono::microseconds;
+
+    // Commands, decoded blocks and sink progress all signal the engine
+    // thread, so there is nothing to poll for while idle.
+    const microseconds idle(1000000);
+    // A sink that is not paced takes the whole queue at every pass. While
+    // it waits on the decoder, poll rather than risk a missed wakeup.
+    if (m_playing && !m_sink->paced()) return microseconds(m_queued.empty() ? 1000 : 0);
+    if (!m_playing || m_queued.empty() || m_sampleRate <= 0) return idle;
+
+    // The visualizer wants a steady refresh while playing.
+    microseconds limit = m_spectrumCb ? microseconds(120000) : idle;
+    if (m_sink->wakesOnProgress()) return limit;
+
+    // Otherwise sleep until the head buffer is due to finish.
+    int64_t remaining = static_cast<int64_t>(
+        m_buffers[m_queued.front()].frames()) - m_sink->position(nullptr);
+    microseconds due(std::max<int64_t>(remaining, 0) * 1000000 / m_sampleRate + 1000);
+    return std::min(due, limit);
+}
+
+void AudioEngine::syncSerial() {
+    uint32_t serial = m_serial.load();
+    if (serial == m_outputSerial) return;
+
+    resetQueue();
+    m_outputSerial = serial;
+}
+
+void AudioEngine::resetQueue() {
+    m_sink->clear();
+    m_sourceStarted = false;
+
+    m_queued.clear();
+    m_free.clear();
+    for (int i = 0; i < MAX_BUFFERS; ++i)
+        m_free.push_back(i);
+    resetStretch();
+    m_limiter.reset();
+    m_limiterHeld = false;
+}
+
+void AudioEngine::reclaimBuffers() {
+    int processed = m_sink->reclaim();
+
+    while (processed-- > 0 && !m_queued.empty()) {
+        m_free.push_back(m_queued.front());
+        m_queued.pop_front();
+    }
+}
+
+void AudioEngine::fillQueue() {
+    while (!m_free.empty() && m_queued.size() < static_cast<size_t>(m_bufferCount)) {
+        // What the stretcher already holds goes out before it takes more.
+        if (m_stretch.active() && takeStretched(m_buffers[m_free.back()], false)) {
+            if (!queueBuffer(m_free.back())) break;
+            m_free.pop_back();
+            continue;
+        }
+
+        PcmBlock* block = m_ring.readSlot();
+        if (!block) {
+            // The decoder is behind while the queue is down to half.
+            if (!m_ringDry && m_sourceStarted && m_sink->paced() &&
+                m_outputSerial == m_serial.load() &&
+                m_eofSerial.load() != m_outputSerial &&
+                m_queued.size() * 2 <= static_cast<size_t>(m_bufferCount)) {
+                m_ringDry = true;
+                noteBufferEvent(OutputBufferEvent::Kind::LowWater);
+            }
+            break;
         }
-        av_packet_unref(packet);
+        m_ringDry = false;
+
+        // Blocks from a request that has been superseded are dropped. A block
+        // newer than the current output serial means a request raced with
+        // this pass, so the queue is restarted for it.
+        if (block->serial != m_outputSerial && block->serial == m_serial.load()) {
+            resetQueue();
+            m_outputSerial = block->serial;
+        }
+        // Buffers in one queue must share a format, so a spliced track
+        // with a different rate or layout waits for the queue to drain.
+        // The limiter's tail goes out first, in the old format.
+        if (block->serial == m_outputSerial &&
+            (block->sampleRate != m_sampleRate || block->channels != m_channels)) {
+            if (m_limiterHeld) {
+                if (!flushLimiter()) break;
+                continue;
+            }
+            if (!m_queued.empty()) break;
+        }
+        if (block->serial == m_outputSerial && fillBuffer(m_free.back(), *block)) {
+            m_free.pop_back();
+
+            uint32_t seekSerial = m_outputSerial;
+            if (m_seekSerial.compare_exchange_strong(seekSerial, 0))
+                pushEvent(AudioEventType::SeekCompleted, currentFile(),
+                          static_cast<double>(block->startFrame) / block->sampleRate);
+        }
+        // At small buffer sizes a block is queued in several parts.
+        if (block->serial == m_outputSerial && m_blockOffset < block->frames) continue;
+
+        m_blockOffset = 0;
+        m_ring.commitRead();
+        m_requestCv.notify_one();
     }
+    drainStretch();
+
+    // At the end of the stream the limiter's lookahead still holds the
+    // last couple of milliseconds.
+    if (m_ring.empty() && m_eofSerial.load() == m_outputSerial &&
+        !m_stretch.active() && m_stretchOut.empty())
+        flushLimiter();
+}
+
+bool AudioEngine::fillBuffer(int slot, const PcmBlock& block) {
+    StreamBuffer& buf = m_buffers[slot];
 
-    if (!m_pcm.empty()) {
-        m_duration.store(
-            static_cast<double>(m_pcm.size()) /
-            (m_sampleRate * 2)
-        );
+    // Off normal speed, and until the stretcher has given back what it
+    // holds, blocks go through it. Back at speed 1 it passes its input
+    // through and empties; the last of its output is queued short and
+    // blocks are queued as they are from then on.
+    double speed = m_speed.load();
+    if (speed == 1.0 && !m_stretch.active() && m_stretchSegmentCount > 0) {
+        bool flushed = takeStretched(buf, true);
+        resetStretch();
+        if (flushed) {
+            m_sampleRate = m_stretch.sampleRate();
+            return queueBuffer(slot);
+        }
+    }
+    if (speed != 1.0 || m_stretch.active()) {
+        if (!stretchBlock(buf, block, speed)) return false;
     } else {
-        m_duration.store(0.0);
+        size_t frames = std::min(block.frames - m_blockOffset, m_bufferFrames);
+        const float* start = block.samples.data() + m_blockOffset * block.channels;
+        buf.pcm.assign(start, start + frames * block.channels);
+        buf.track = block.track;
+        buf.channels = block.channels;
+        buf.startFrame = block.startFrame + static_cast<int64_t>(m_blockOffset);
+        buf.speed = 1.0;
+        m_blockOffset += frames;
     }
+    m_sampleRate = block.sampleRate;
+    return queueBuffer(slot);
+}
+
+bool AudioEngine::stretchBlock(StreamBuffer& buf, const PcmBlock& block, double speed) {
+    if (m_stretch.sampleRate() != block.sampleRate || m_stretch.channels() != block.channels) {
+        m_stretch.configure(block.sampleRate, block.channels, BUFFER_FRAMES);
+        resetStretch();
+    }
+    m_stretch.setSpeed(speed);
 
-    av_frame_free(&frame);
-    av_packet_free(&packet);
-    swr_free(&swr);
-    avcodec_free_context(&codec_ctx);
-    avformat_close_input(&fmt_ctx);
+    // The rest of the block goes in whole.
+    size_t offset = m_blockOffset;
+    m_blockOffset = block.frames;
+    m_stretchSegments[m_stretchSegmentCount++ % m_stretchSegments.size()] =
+        {m_stretchInput, block.track, block.startFrame + static_cast<int64_t>(offset)};
+    m_stretchInput += static_cast<int64_t>(block.frames - offset);
+    m_stretch.push(block.samples.data() + offset * block.channels, block.frames - offset);
+    return takeStretched(buf, false);
+}
 
-    if (m_pcm.empty()) return false;
+bool AudioEngine::takeStretched(StreamBuffer& buf, bool flush) {
+    const int channels = m_stretch.channels();
+    size_t have = m_stretchOut.size() / channels;
+    size_t want = std::max(m_bufferFrames, have);
+    m_stretchOut.resize(want * channels);
+    double* first = have == 0 ? &m_stretchOutSource : nullptr;
+    have += m_stretch.pull(m_stretchOut.data() + have * channels, want - have, first);
+    m_stretchOut.resize(have * channels);
+
+    // Short buffers only at the end of the stream.
+    if (have == 0 || (have < want && !flush) || m_stretchSegmentCount == 0) return false;
+    buf.pcm.swap(m_stretchOut);
+    m_stretchOut.clear();
+    const double source = m_stretchOutSource;
+
+    // The newest block starting at or before the first output frame.
+    size_t count = std::min(m_stretchSegmentCount, m_stretchSegments.size());
+    const StretchSegment* segment = nullptr;
+    for (size_t i = 1; i <= count; ++i) {
+        segment = &m_stretchSegments[(m_stretchSegmentCount - i) % m_stretchSegments.size()];
+        if (segment->input <= source) break;
+    }
+    buf.track = segment->track;
+    buf.startFrame = segment->startFrame +
+                     std::max<int64_t>(std::llround(source) - segment->input, 0);
+    buf.channels = channels;
+    buf.speed = m_stretch.speed();
+    return true;
+}
+
+void AudioEngine::drainStretch() {
+    // At the end of the stream the stretcher still holds the last frame
+    // or so; flush it into the queue.
+    if ((!m_stretch.active() && m_stretchOut.empty()) || !m_ring.empty() ||
+        m_eofSerial.load() != m_outputSerial)
+        return;
+
+    m_stretch.drain();
+    while (!m_free.empty() && m_queued.size() < static_cast<size_t>(m_bufferCount)) {
+        int slot = m_free.back();
+        if (!takeStretched(m_buffers[slot], true) || !queueBuffer(slot)) {
+            resetStretch();
+            return;
+        }
+        m_free.pop_back();
+    }
+}
+
+void AudioEngine::resetStretch() {
+    m_stretch.reset();
+    m_stretchSegmentCount = 0;
+    m_stretchInput = 0;
+    m_stretchOut.clear();
+}
+
+bool AudioEngine::queueBuffer(int slot) {
+    StreamBuffer& buf = m_buffers[slot];
+    m_channels = buf.channels;
+
+    // Volume and limiting go into a separate buffer, so the spectrum tap
+    // keeps seeing the signal before them.
+    if (m_limiter.sampleRate() != m_sampleRate || m_limiter.channels() != m_channels)
+        m_limiter.configure(m_sampleRate, m_channels, BUFFER_FRAMES);
+    m_limiter.process(buf.pcm.data(), m_output.data(), buf.frames());
+    m_limiterHeld = true;
+    m_limiterTrack = buf.track;
+    m_limiterEnd = buf.startFrame + std::llround(buf.frames() * buf.speed);
+    m_limiterSpeed = buf.speed;
+    return submitBuffer(slot);
+}
+
+bool AudioEngine::flushLimiter() {
+    if (!m_limiterHeld || m_free.empty()) return false;
+
+    // A buffer of silence stands in for the frames the limiter writes, so
+    // the spectrum tap and the clock see a buffer like any other.
+    int slot = m_free.back();
+    StreamBuffer& buf = m_buffers[slot];
+    const size_t frames = m_limiter.latency();
+    buf.pcm.assign(frames * m_limiter.channels(), 0.0f);
+    buf.track = m_limiterTrack;
+    buf.startFrame = m_limiterEnd;
+    buf.channels = m_limiter.channels();
+    buf.speed = m_limiterSpeed;
+    m_limiter.flush(m_output.data());
+    m_limiterHeld = false;
+
+    if (!submitBuffer(slot)) return false;
+    m_free.pop_back();
+    return true;
+}
+
+bool AudioEngine::submitBuffer(int slot) {
+    StreamBuffer& buf = m_buffers[slot];
+
+    // A sink without float output only takes S16, so convert at the very
+    // end of the pipeline.
+    const void* samples = m_output.data();
+    if (!m_floatOutput) {
+        FloatToS16(m_output.data(), m_pcm16.data(), buf.pcm.size());
+        samples = m_pcm16.data();
+    }
+    if (!m_sink->queue(slot, samples, buf.frames(), m_channels, m_sampleRate)) return false;
+
+    m_queued.push_back(slot);
+    return true;
+}
+
+bool AudioEngine::readyToStart() const {
+    if (m_queued.empty()) return false;
+    if (m_queued.size() >= static_cast<size_t>(m_bufferCount) ||
+        m_eofSerial.load() == m_outputSerial)
+        return true;
+
+    size_t queued = 0;
+    for (int slot : m_queued)
+        queued += m_buffers[slot].frames();
+    return queued >= static_cast<size_t>(START_SECONDS * m_sampleRate);
+}
+
+void AudioEngine::adaptBuffers(bool playing) {
+    int64_t now = NowNs();
+    if (playing && m_adaptLastNs != 0) m_quietNs += now - m_adaptLastNs;
+    m_adaptLastNs = now;
+
+    // The bounds may have moved since the last pass.
+    int count = std::clamp(m_bufferCount, m_minBuffers.load(), m_maxBuffers.load());
+    size_t frames = std::clamp(m_bufferFrames, m_minBufferFrames.load(), m_maxBufferFrames.load());
+    // So may the sample rate, and with it the frames a latency cap allows.
+    const size_t cap = queueFrameCap();
+    while (static_cast<size_t>(count) * frames > cap) {
+        if (frames > m_minBufferFrames.load())
+            frames = std::max(frames / 2, m_minBufferFrames.load());
+        else if (count > m_minBuffers.load())
+            --count;
+        else
+            break;
+    }
+    bool changed = count != m_bufferCount || frames != m_bufferFrames ||
+                   m_sampleRate != m_statsRate || m_maxLatency.load() != m_outputStats.maxLatency;
+    m_bufferCount = count;
+    m_bufferFrames = frames;
+
+    if (m_quietNs >= static_cast<int64_t>(SHRINK_AFTER_SECONDS * 1e9)) {
+        m_quietNs = 0;
+        if (shrinkBuffers()) {
+            recordBufferEvent(OutputBufferEvent::Kind::Shrink, now);
+            return;
+        }
+    }
+    if (changed) {
+        std::lock_guard<std::mutex> lock(m_outputStatsMutex);
+        m_statsRate = m_sampleRate;
+        m_outputStats.buffers = m_bufferCount;
+        m_outputStats.bufferFrames = m_bufferFrames;
+        m_outputStats.latency = m_sampleRate > 0
+            ? static_cast<double>(m_bufferCount * m_bufferFrames) / m_sampleRate : 0.0;
+        m_outputStats.maxLatency = m_maxLatency.load();
+    }
+}
+
+void AudioEngine::noteBufferEvent(OutputBufferEvent::Kind kind) {
+    int64_t now = NowNs();
+    m_quietNs = 0;
+    recordBufferEvent(kind, now);
+
+    // An underrun was heard and grows the queue two steps; a low-water
+    // mark only warns, so it grows one step at most every few seconds.
+    int steps = 1;
+    if (kind == OutputBufferEvent::Kind::Underrun)
+        steps = 2;
+    else if (now - m_lastGrowNs < static_cast<int64_t>(LOW_WATER_HOLDOFF_SECONDS * 1e9))
+        steps = 0;
+
+    bool grew = false;
+    while (steps-- > 0) grew |= growBuffers();
+    if (grew) {
+        m_lastGrowNs = now;
+        recordBufferEvent(OutputBufferEvent::Kind::Grow, now);
+    }
+}
+
+void AudioEngine::recordBufferEvent(OutputBufferEvent::Kind kind, int64_t now) {
+    std::lock_guard<std::mutex> lock(m_outputStatsMutex);
+    switch (kind) {
+    case OutputBufferEvent::Kind::Underrun: ++m_outputStats.underruns; break;
+    case OutputBufferEvent::Kind::LowWater: ++m_outputStats.lowWater; break;
+    case OutputBufferEvent::Kind::Grow:     ++m_outputStats.grows; break;
+    case OutputBufferEvent::Kind::Shrink:   ++m_outputStats.shrinks; break;
+    }
+    m_statsRate = m_sampleRate;
+    m_outputStats.buffers = m_bufferCount;
+    m_outputStats.bufferFrames = m_bufferFrames;
+    m_outputStats.latency = m_sampleRate > 0
+        ? static_cast<double>(m_bufferCount * m_bufferFrames) / m_sampleRate : 0.0;
+    m_outputStats.maxLatency = m_maxLatency.load();
+
+    m_bufferHistory.push_back({kind, now / 1e9, m_bufferCount, m_bufferFrames});
+    while (m_bufferHistory.size() > MAX_BUFFER_HISTORY) m_bufferHistory.pop_front();
+}
+
+size_t AudioEngine::queueFrameCap() const {
+    double maxLatency = m_maxLatency.load();
+    if (maxLatency <= 0.0 || m_sampleRate <= 0)
+        return static_cast<size_t>(MAX_BUFFERS) * BUFFER_FRAMES;
+    size_t floor = static_cast<size_t>(m_minBuffers.load()) * m_minBufferFrames.load();
+    return std::max(static_cast<size_t>(maxLatency * m_sampleRate), floor);
+}
+
+bool AudioEngine::growBuffers() {
+    // More buffers first, so refills stay fine-grained; then larger ones.
+    const size_t cap = queueFrameCap();
+    if (m_bufferCount < m_maxBuffers.load() &&
+        static_cast<size_t>(m_bufferCount + 1) * m_bufferFrames <= cap) {
+        ++m_bufferCount;
+        return true;
+    }
+    size_t frames = std::min(m_bufferFrames * 2, m_maxBufferFrames.load());
+    if (frames > m_bufferFrames && static_cast<size_t>(m_bufferCount) * frames <= cap) {
+        m_bufferFrames = frames;
+        return true;
+    }
+    return false;
+}
+
+bool AudioEngine::shrinkBuffers() {
+    // The reverse of growBuffers(). Queued buffers are left to play out.
+    size_t minFrames = m_minBufferFrames.load();
+    if (m_bufferFrames > minFrames) {
+        m_bufferFrames = std::max(m_bufferFrames / 2, minFrames);
+        return true;
+    }
+    if (m_bufferCount > m_minBuffers.load()) {
+        --m_bufferCount;
+        return true;
+    }
+    return false;
+}
+
+void AudioEngine::startSource() {
+    m_sink->play();
+    m_sourceStarted = true;
+
+    int64_t start = m_loadStartNs.exchange(0);
+    if (start != 0)
+        m_timeToFirstAudio.store((NowNs() - start) / 1e9);
+}
+
+int64_t AudioEngine::playbackFrame(int64_t* latencyNs) const {
+    if (m_queued.empty()) return 0;
+
+    int64_t offset = m_sink->position(latencyNs);
+    const StreamBuffer& head = m_buffers[m_queued.front()];
+    return head.startFrame + std::llround(offset * head.speed);
+}
+
+void AudioEngine::publishClock(AudioSink::State state) {
+    // Nothing queued (loading, seeking or finished): hold the clock.
+    if (m_queued.empty() || m_sampleRate <= 0) {
+        m_clock.freeze();
+        return;
+    }
 
-    alGenBuffers(1, &m_buffer);
-    alBufferData(m_buffer,
-                 FormatFromChannels(2),
-                 m_pcm.data(),
-                 static_cast<ALsizei>(m_pcm.size() * sizeof(int16_t)),
-                 m_sampleRate);
+    int64_t latencyNs = 0;
+    int64_t now = NowNs();
+    int64_t frame = playbackFrame(&latencyNs);
 
-    return alGetError() == AL_NO_ERROR;
+    // The limiter's lookahead delays the output a little, and what is
+    // audible lags the mixer by the device latency.
+    double speed = m_buffers[m_queued.front()].speed;
+    bool running = state == AudioSink::State::Playing;
+    frame -= std::llround(m_limiter.latency() * speed);
+    if (running) frame -= static_cast<int64_t>(latencyNs * (m_sampleRate * speed) / 1e9);
+    m_clock.set(std::max<int64_t>(frame, 0), m_sampleRate, now, running, speed);
 }
 
-void AudioEngine::updateSpectrum(const int16_t* samples) {
+void AudioEngine::updateSpectrum(const float* samples, int channels) {
     if (!m_spectrumCb) return;
 
-    std::vector<std::complex<float>> in(FFT_SIZE);
+    std::vector<std::complex<float>>& in = m_fftIn;
     for (size_t i = 0; i < FFT_SIZE; ++i) {
-        float s = samples[i * 2] / 32768.0f; 
+        float s = samples[i * channels];
         in[i] = std::complex<float>(s * m_window[i], 0.0f);
     }
 
-    std::vector<std::complex<float>> out(FFT_SIZE);
-    m_fft.transform(in.data(), out.data());
+    m_fft.transform(in.data(), m_fftOut.data());
 
-    std::vector<float> bins(64);
     for (int i = 0; i < 64; ++i)
-        bins[i] = std::abs(out[i]);
+        m_bins[i] = std::abs(m_fftOut[i]);
 
-    m_spectrumCb(bins.data(), 64);
+    m_spectrumCb(m_bins.data(), 64);
 }
 
 float computeRMS(const std::vector<float>& spectrum) {
@@ -7,6 +7,8 @@
 #include <functional>
 #include <optional>
 #include <vector>
+#include <array>
+#include <deque>
 #include "files.h"
 
 extern "C" {
@@ -14,15 +16,45 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
 }
-#include <AL/al.h>
-#include <AL/alc.h>
+#include <condition_variable>
+#include <memory>
+#include <future>
+#include <chrono>
 
 #include <kissfft.hh>  
 #include "AudioManager.h"
+#include "AudioDecoder.h"
+#include "RingBuffer.h"
+#include "AudioMix.h"
+#include "CommandQueue.h"
+#include "PlaybackClock.h"
+#include "TimeStretch.h"
+#include "Realtime.h"
+#include "AudioSink.h"
+#include "GainLimiter.h"
 
+enum class AudioEventType {
+    TrackStarted,
+    TrackEnded,
+    BufferUnderrun,
+    SeekCompleted
+};
+
+struct AudioEvent {
+    AudioEventType type{AudioEventType::TrackStarted};
+    uint32_t       serial{0};
+    std::string    file;
+    double         position{0.0};
+};
+
+// All sink calls happen on the engine thread. The public transport
+// methods only post commands to it (or decode requests to the decode
+// thread), so they are safe to call from any thread and never block.
 class AudioEngine {
 public:
-    AudioEngine();
+    // Plays through OpenAL unless given another sink, such as a NullSink
+    // or FileSink for headless runs.
+    explicit AudioEngine(std::unique_ptr<AudioSink> sink = nullptr);
     ~AudioEngine();
     
     void loadAndPlay(const std::string& filePath);
@@ -31,39 +63,378 @@ public:
     void playPause();
     void stop();
     void seek(double seconds);
+    // Software volume from 0 to 2, ramped per sample. Anything pushed
+    // above 0 dBFS is caught by a true-peak limiter instead of clipping.
+    // It is applied as buffers are queued, so a change is heard once the
+    // audio already queued has played: OutputBufferStats::latency at most.
     void setVolume(float v);
 
+    // Playback speed from 0.5x to 3x with the pitch kept, for spoken word
+    // and practice. Applies from the next buffer handed to the device.
+    void setSpeed(double speed);
+    double speed() const { return m_speed.load(); }
+
+    // Track to splice on, gaplessly, when the current one ends. Its first
+    // seconds are pre-decoded shortly before the end of the current track.
+    void setNextTrack(const std::string& filePath);
+
+    // Overlap between consecutive tracks, 0 (gapless) to 12 seconds.
+    void setCrossfade(double seconds, FadeCurve curve = FadeCurve::EqualPower);
+    double crossfade() const { return m_crossfadeSeconds.load(); }
+    FadeCurve crossfadeCurve() const { return m_crossfadeCurve.load(); }
+
+    // Repeat loops the current track gaplessly. The engine does nothing
+    // with shuffle but store it: the GUI's QueueNextTrack reads it, picks
+    // a random entry and passes that to setNextTrack().
+    void setRepeat(bool repeat);
+    void setShuffle(bool shuffle);
+    bool repeat() const { return m_repeat.load(); }
+    bool shuffle() const { return m_shuffle.load(); }
+
+    // Pops the next playback event, emitted as buffers complete. Returns
+    // false when there is none.
+    bool pollEvent(AudioEvent& event);
+    uint64_t underruns() const { return m_underruns.load(); }
+    GainLimiter::Stats limiterStats() const { return m_limiter.stats(); }
+
+    // The output queue adapts to its own telemetry. An underrun, or the ring
+    // running dry while the queue is half empty, grows it: one more buffer
+    // at a time, then larger buffers. Half a minute of clean playback
+    // shrinks it a step, to keep seeks and commands responsive. Buffer
+    // sizes are in frames. A non-zero maxLatency also stops growth past
+    // that many seconds of queued audio, which bounds how late volume
+    // changes are heard; minBuffers of minFrames are always allowed.
+    void setOutputBufferBounds(int minBuffers, int maxBuffers,
+                               size_t minFrames, size_t maxFrames,
+                               double maxLatency = 0.0);
+    struct OutputBufferEvent {
+        enum class Kind { Underrun, LowWater, Grow, Shrink };
+        Kind   kind{Kind::Underrun};
+        double time{0.0};  // steady-clock seconds
+        int    buffers{0};
+        size_t bufferFrames{0};
+    };
+    struct OutputBufferStats {
+        int      buffers{0};
+        size_t   bufferFrames{0};
+        double   latency{0.0};     // seconds held by a full queue
+        double   maxLatency{0.0};  // cap from setOutputBufferBounds, 0 if none
+        uint64_t underruns{0};
+        uint64_t lowWater{0};
+        uint64_t grows{0};
+        uint64_t shrinks{0};
+        std::vector<OutputBufferEvent> history;  // oldest first
+    };
+    OutputBufferStats outputBufferStats() const;
+
     bool isPlaying() const { return m_playing.load(); }
-    double position() const { return m_position.load(); }
+    // Interpolated between engine updates and corrected for output
+    // latency; safe to call from any thread.
+    double position() const { return m_clock.now().seconds; }
+    PlaybackClock::Time playbackTime() const { return m_clock.now(); }
     double duration() const { return m_duration.load(); }
     float volume() const { return m_volume.load(); }
     std::string currentFile() const;
     std::optional<AudioMetadata> currentMetadata() const;
 
+    struct PcmBlock {
+        uint32_t             serial{0};
+        uint32_t             track{0};
+        int                  sampleRate{0};
+        int                  channels{2};
+        int64_t              startFrame{0};
+        size_t               frames{0};
+        std::vector<float>   samples;
+    };
+    using PcmRing = RingBuffer<PcmBlock>;
+    PcmRing::Stats ringStats() const { return m_ring.stats(); }
+
+    // Seconds from the last loadAndPlay() call until its first sample was
+    // handed to the device, or a negative value while still pending.
+    double timeToFirstAudio() const { return m_timeToFirstAudio.load(); }
+
+    // Time between posting a transport command and the engine thread
+    // applying it.
+    struct CommandStats {
+        uint64_t count{0};
+        double   lastMs{0.0};
+        double   maxMs{0.0};
+        double   avgMs{0.0};
+    };
+    CommandStats commandStats() const;
+
+    // Packet read-ahead between demuxing and decoding. The queue is capped
+    // by whichever limit is reached first.
+    void setReadAhead(size_t maxBytes, double maxSeconds);
+    struct ReadAheadStats {
+        size_t   maxBytes{0};
+        double   maxSeconds{0.0};
+        uint64_t packets{0};
+        uint64_t bytes{0};
+        uint64_t readStalls{0};
+        uint64_t decodeStalls{0};
+    };
+    ReadAheadStats readAheadStats() const;
+
+    // Recently decoded tracks are kept in memory up to this many bytes, so
+    // replaying them needs no decoding.
+    void setPcmCacheBudget(size_t bytes) { m_pcmCache.setBudget(bytes); }
+    PcmCache::Stats pcmCacheStats() const { return m_pcmCache.stats(); }
+    // Fully decoded tracks of costly codecs are also written to `directory`
+    // and mapped back in on later runs. Off until enabled here;
+    // maxBytes == 0 disables it again.
+    void setDiskCache(const std::string& directory, uint64_t maxBytes) {
+        m_diskCache.configure(directory, maxBytes);
+    }
+    DiskPcmCache::Stats diskCacheStats() const { return m_diskCache.stats(); }
+
+    // Upcoming queue entries, soonest first. Their files are read into
+    // memory in the background, up to the prefetch budget, so opening
+    // them later needs no disk or network I/O.
+    void setUpcoming(std::vector<std::string> files) { m_prefetch.setUpcoming(std::move(files)); }
+    void setPrefetchBudget(size_t bytes) { m_prefetch.setBudget(bytes); }
+    TrackPrefetch::Stats prefetchStats() const { return m_prefetch.stats(); }
+
+    // Seek indexes of fully played tracks, reused on later runs.
+    SeekTableStore::Stats seekTableStats() const { return m_seekTables.stats(); }
+
+    // Opt-in real-time mode for machines under load: the output thread
+    // asks for real-time scheduling, the decode thread for a raised
+    // priority, and the ring and output buffers are locked in memory.
+    // Each part falls back on its own when the OS refuses; the status
+    // tells what is in effect.
+    struct RealtimeStatus {
+        bool                requested{false};
+        ThreadPriorityLevel output{ThreadPriorityLevel::Normal};
+        ThreadPriorityLevel decode{ThreadPriorityLevel::Normal};
+        std::string         outputMethod;
+        std::string         decodeMethod;
+        bool                memoryLocked{false};
+        size_t              lockedBytes{0};
+    };
+    void setRealtime(bool enabled);
+    RealtimeStatus realtimeStatus() const;
+
     using SpectrumCallback = std::function<void(const float*, int)>;
     void setSpectrumCallback(SpectrumCallback cb) { m_spectrumCb = cb; }
 
 private:
-    void workerThread();
-    bool decodeFile(const std::string& path);
-    void updateSpectrum(const int16_t* samples);
-    
-    ALCdevice*  m_device{nullptr};
-    ALCcontext* m_context{nullptr};
-    ALuint      m_source{0};
-    ALuint      m_buffer{0};
-    
-    AVFormatContext* m_fmt{nullptr};
-    AVCodecContext*  m_codec{nullptr};
-    SwrContext*      m_swr{nullptr};
-    int              m_streamIdx{-1};
-    
-    std::vector<int16_t> m_pcm;
-    int m_sampleRate{0};
+    struct StreamBuffer {
+        uint32_t             track{0};
+        int64_t              startFrame{0};
+        int                  channels{2};
+        double               speed{1.0};  // track frames per buffer frame
+        std::vector<float>   pcm;
+
+        size_t frames() const { return pcm.size() / channels; }
+    };
+
+    enum class CommandType {
+        Play,
+        Pause,
+        PlayPause,
+        Stop,
+        SetVolume
+    };
+
+    struct Command {
+        CommandType type{CommandType::Play};
+        float       value{0.0f};
+        int64_t     postedNs{0};
+    };
+
+    void post(CommandType type, float value = 0.0f);
+    void wakeOutput();
+    void pushEvent(AudioEventType type, const std::string& file, double position);
+    std::chrono::microseconds nextWakeup() const;
+    static std::string DefaultCachePath(const char* name);
+    void processCommands();
+    void applyOutputRealtime(bool enabled);
+    void applyDecodeRealtime(bool enabled);
+    void openDevice();
+    void closeDevice();
+
+    void engineThread(std::promise<void> started);
+    void decodeThread();
+    void updateSpectrum(const float* samples, int channels);
+
+    struct TrackInfo {
+        uint32_t    track{0};
+        std::string file;
+        double      duration{0.0};
+    };
+
+    uint32_t requestDecode(const std::string& file, double seconds);
+    bool decodeBlock(uint32_t serial);
+    size_t readFrames(float* out, size_t frames);
+    bool openTrack(const std::string& file);
+    bool prerollNext(const std::string& file);
+    bool spliceNext();
+    bool startCrossfade(const std::string& file, int64_t length);
+    size_t mixCrossfade(float* out, size_t frames);
+    std::string nextFile() const;
+    const std::string& nextFileLocked() const;
+    void beginTrack(const std::string& file);
+    void updatePlayingTrack();
+
+    void syncSerial();
+    void resetQueue();
+    void reclaimBuffers();
+    void fillQueue();
+    bool fillBuffer(int slot, const PcmBlock& block);
+    bool stretchBlock(StreamBuffer& buf, const PcmBlock& block, double speed);
+    bool takeStretched(StreamBuffer& buf, bool flush);
+    void drainStretch();
+    void resetStretch();
+    bool queueBuffer(int slot);
+    bool flushLimiter();
+    bool submitBuffer(int slot);
+    bool readyToStart() const;
+    void adaptBuffers(bool playing);
+    void noteBufferEvent(OutputBufferEvent::Kind kind);
+    void recordBufferEvent(OutputBufferEvent::Kind kind, int64_t now);
+    size_t queueFrameCap() const;
+    bool growBuffers();
+    bool shrinkBuffers();
+    void startSource();
+    int64_t playbackFrame(int64_t* latencyNs = nullptr) const;
+    void publishClock(AudioSink::State state);
+
+    std::unique_ptr<AudioSink> m_sink;
+
+    static constexpr int    MAX_BUFFERS   = 12;
+    static constexpr size_t BUFFER_FRAMES = 8192;
+    // The spectrum tap needs a whole FFT window inside one buffer.
+    static constexpr size_t MIN_BUFFER_FRAMES = 2048;
+    static constexpr size_t RING_BLOCKS   = 8;
+    // Output-side state is sized for this rate up front, so no format
+    // change below it reallocates on the engine thread.
+    static constexpr int    MAX_SAMPLE_RATE = 384000;
+    static constexpr double START_SECONDS = 0.25;
+    static constexpr double SHRINK_AFTER_SECONDS = 30.0;
+    static constexpr double LOW_WATER_HOLDOFF_SECONDS = 2.0;
+    static constexpr size_t MAX_BUFFER_HISTORY = 32;
+
+    std::array<StreamBuffer, MAX_BUFFERS> m_buffers;
+    std::deque<int>      m_queued;
+    std::vector<int>     m_free;
+    // Frames of the ring's read slot already queued, when a block spans
+    // several output buffers.
+    size_t               m_blockOffset{0};
+
+    // Queue shape, owned by the engine thread, and its bounds.
+    int                  m_bufferCount{4};
+    size_t               m_bufferFrames{4096};
+    std::atomic<int>     m_minBuffers{3};
+    std::atomic<int>     m_maxBuffers{MAX_BUFFERS};
+    std::atomic<size_t>  m_minBufferFrames{MIN_BUFFER_FRAMES};
+    std::atomic<size_t>  m_maxBufferFrames{BUFFER_FRAMES};
+    std::atomic<double>  m_maxLatency{0.0};
+    int64_t              m_adaptLastNs{0};
+    int64_t              m_quietNs{0};
+    int64_t              m_lastGrowNs{0};
+    bool                 m_ringDry{false};
+    int                  m_statsRate{0};
+    mutable std::mutex   m_outputStatsMutex;
+    OutputBufferStats    m_outputStats;
+    std::deque<OutputBufferEvent> m_bufferHistory;
+    uint32_t             m_outputSerial{0};
+    uint32_t             m_playingTrack{0};
+    uint32_t             m_playingSerial{0};
+    bool                 m_sourceStarted{false};
+    bool                 m_floatOutput{false};
+    std::vector<int16_t> m_pcm16;
+    int                  m_sampleRate{0};
+    int                  m_channels{2};
+
+    // Time-stretch stage between the ring and the output queue. Each block
+    // pushed into it is recorded with its position in the stretcher's
+    // input, so output can be mapped back to track frames.
+    struct StretchSegment {
+        int64_t  input{0};
+        uint32_t track{0};
+        int64_t  startFrame{0};
+    };
+    TimeStretch          m_stretch;
+    std::array<StretchSegment, 8> m_stretchSegments;
+    size_t               m_stretchSegmentCount{0};
+    int64_t              m_stretchInput{0};
+    // Stretched output collects here until it fills a buffer.
+    std::vector<float>   m_stretchOut;
+    double               m_stretchOutSource{0.0};
+
+    // Volume and limiter, the last stage before the sink.
+    GainLimiter          m_limiter;
+    std::vector<float>   m_output;
+    // Whether the limiter holds frames back, and where in the track they
+    // end, for the buffer that flushes them.
+    bool                 m_limiterHeld{false};
+    uint32_t             m_limiterTrack{0};
+    int64_t              m_limiterEnd{0};
+    double               m_limiterSpeed{1.0};
+    std::atomic<double>  m_speed{1.0};
+
+    // Real-time mode. Each thread applies the request to itself; the
+    // grants are only touched by their own thread.
+    std::atomic<bool>    m_realtime{false};
+    bool                 m_outputRealtime{false};
+    bool                 m_decodeRealtime{false};
+    PriorityGrant        m_outputGrant;
+    PriorityGrant        m_decodeGrant;
+    MemoryLock           m_memoryLock;
+    mutable std::mutex   m_realtimeMutex;
+    RealtimeStatus       m_realtimeStatus;
+
+    static constexpr double PREROLL_SECONDS = 2.0;
+    static constexpr double PREROLL_LEAD    = 15.0;
+    static constexpr double MAX_CROSSFADE   = 12.0;
+
+    // Decoder state, owned by the decode thread. m_head holds pre-rolled
+    // frames of the active track that were decoded before it was spliced in.
+    std::unique_ptr<AudioDecoder> m_decoder{std::make_unique<AudioDecoder>()};
+    std::unique_ptr<AudioDecoder> m_nextDecoder{std::make_unique<AudioDecoder>()};
+    std::string          m_decodeFile;
+    std::string          m_prerollFile;
+    std::vector<float>   m_head;
+    size_t               m_headPos{0};
+    std::vector<float>   m_preroll;
+    int64_t              m_decodeFrame{0};
+    uint32_t             m_decodeTrack{0};
+
+    // Outgoing track while a crossfade is running.
+    std::unique_ptr<AudioDecoder> m_fadeDecoder{std::make_unique<AudioDecoder>()};
+    int64_t              m_fadeLength{0};
+    int64_t              m_fadePos{0};
+    std::vector<float>   m_fadeSamples;
+    std::vector<float>   m_fadeOutGain;
+    std::vector<float>   m_fadeInGain;
+
+    std::atomic<double>    m_crossfadeSeconds{0.0};
+    std::atomic<FadeCurve> m_crossfadeCurve{FadeCurve::EqualPower};
+
+    PcmRing               m_ring{RING_BLOCKS};
+    std::atomic<uint32_t> m_serial{0};
+    std::atomic<uint32_t> m_eofSerial{0};
+    std::atomic<uint32_t> m_seekSerial{0};
+    std::atomic<uint64_t> m_underruns{0};
+    PacketReader::Control m_readAhead;
+    PcmCache              m_pcmCache{256u << 20};
+    DiskPcmCache          m_diskCache{DefaultCachePath("pcm-cache"), 0};
+    SeekTableStore        m_seekTables{DefaultCachePath("seek-tables.bin")};
+    TrackPrefetch         m_prefetch{64u << 20};
+
+    std::atomic<int64_t>  m_loadStartNs{0};
+    std::atomic<double>   m_timeToFirstAudio{0.0};
+
+    CommandQueue<Command> m_commands{64};
+    std::atomic<uint64_t> m_commandCount{0};
+    std::atomic<int64_t>  m_commandLastNs{0};
+    std::atomic<int64_t>  m_commandMaxNs{0};
+    std::atomic<int64_t>  m_commandTotalNs{0};
     
     std::atomic<bool>    m_running{true};
     std::atomic<bool>    m_playing{false};
-    std::atomic<double>  m_position{0.0};
+    PlaybackClock        m_clock;
     std::atomic<double>  m_duration{0.0};
     std::atomic<float>   m_volume{0.5f};
     std::string          m_currentFile;
@@ -73,12 +444,30 @@ private:
     SpectrumCallback     m_spectrumCb;
     kissfft<float>       m_fft;
     std::vector<float>   m_window;
+    std::vector<std::complex<float>> m_fftIn;
+    std::vector<std::complex<float>> m_fftOut;
+    std::vector<float>   m_bins;
     static constexpr size_t FFT_SIZE = 2048;
 
     std::thread m_thread;
+    std::thread m_decodeThread;
     std::atomic<bool> m_needNewTrack{false};
     std::string m_pendingFile;
-    std::mutex m_trackMutex;
+    double m_pendingSeek{0.0};
+    std::string m_nextFile;
+    std::string m_nextAfter;
+    std::deque<TrackInfo> m_tracks;
+    mutable std::mutex m_requestMutex;
+    std::condition_variable m_requestCv;
+    static constexpr size_t MAX_EVENTS = 64;
+    std::deque<AudioEvent> m_events;
+    std::mutex m_eventMutex;
+
+    // Set under m_wakeMutex by every wakeOutput(), so a wakeup posted while
+    // the output thread is busy is seen by its next wait.
+    std::mutex m_wakeMutex;
+    std::condition_variable m_outputCv;
+    std::atomic<bool> m_wakePending{false};
 };
 
 float computeRMS(const std::vector<float>& spectrum);
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include "AudioMix.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_MIX_SSE2 1
+#endif
+
+void FadeGains(FadeCurve curve, int64_t pos, int64_t length, size_t frames,
+               float* fadeOut, float* fadeIn) {
+    const float halfPi = 0.5f * static_cast<float>(M_PI);
+
+    for (size_t i = 0; i < frames; ++i) {
+        float t = length > 0
+            ? std::clamp(static_cast<float>(pos + static_cast<int64_t>(i)) / length, 0.0f, 1.0f)
+            : 1.0f;
+
+        switch (curve) {
+        case FadeCurve::Linear:
+            fadeOut[i] = 1.0f - t;
+            fadeIn[i] = t;
+            break;
+        case FadeCurve::EqualPower:
+            fadeOut[i] = std::cos(t * halfPi);
+            fadeIn[i] = std::sin(t * halfPi);
+            break;
+        case FadeCurve::SCurve: {
+            float s = t * t * (3.0f - 2.0f * t);
+            fadeOut[i] = 1.0f - s;
+            fadeIn[i] = s;
+            break;
+        }
+        }
+    }
+}
+
+void MixCrossfade(const float* a, const float* b,
+                  const float* gainA, const float* gainB,
+                  float* out, size_t frames, int channels) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    if (channels == 2) {
+        // Four stereo frames per iteration, with the per-frame gains
+        // duplicated across L/R.
+        for (; i + 4 <= frames; i += 4) {
+            __m128 ga = _mm_loadu_ps(gainA + i);
+            __m128 gb = _mm_loadu_ps(gainB + i);
+
+            __m128 aLo = _mm_loadu_ps(a + i * 2);
+            __m128 aHi = _mm_loadu_ps(a + i * 2 + 4);
+            __m128 bLo = _mm_loadu_ps(b + i * 2);
+            __m128 bHi = _mm_loadu_ps(b + i * 2 + 4);
+
+            __m128 lo = _mm_add_ps(_mm_mul_ps(aLo, _mm_unpacklo_ps(ga, ga)),
+                                   _mm_mul_ps(bLo, _mm_unpacklo_ps(gb, gb)));
+            __m128 hi = _mm_add_ps(_mm_mul_ps(aHi, _mm_unpackhi_ps(ga, ga)),
+                                   _mm_mul_ps(bHi, _mm_unpackhi_ps(gb, gb)));
+
+            _mm_storeu_ps(out + i * 2, lo);
+            _mm_storeu_ps(out + i * 2 + 4, hi);
+        }
+    }
+#endif
+
+    for (; i < frames; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            size_t s = i * channels + c;
+            out[s] = a[s] * gainA[i] + b[s] * gainB[i];
+        }
+    }
+}
+
+void DownmixStereo(const float* in, int channels, const float* matrix,
+                   float* out, size_t frames) {
+    const float* gainL = matrix;
+    const float* gainR = matrix + channels;
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    // Two output frames per iteration as L0 R0 L1 R1: each input channel
+    // is broadcast into its L/R lanes and scaled by (gainL, gainR).
+    if (channels <= 8) {
+        __m128 gains[8];
+        for (int c = 0; c < channels; ++c)
+            gains[c] = _mm_setr_ps(gainL[c], gainR[c], gainL[c], gainR[c]);
+
+        for (; i + 2 <= frames; i += 2) {
+            const float* f0 = in + i * channels;
+            const float* f1 = f0 + channels;
+            __m128 acc = _mm_setzero_ps();
+            for (int c = 0; c < channels; ++c)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_setr_ps(f0[c], f0[c], f1[c], f1[c]), gains[c]));
+            _mm_storeu_ps(out + i * 2, acc);
+        }
+    }
+#endif
+
+    for (; i < frames; ++i) {
+        const float* f = in + i * channels;
+        float l = 0.0f, r = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            l += f[c] * gainL[c];
+            r += f[c] * gainR[c];
+        }
+        out[i * 2] = l;
+        out[i * 2 + 1] = r;
+    }
+}
+
+void S16ToFloat(const int16_t* in, float* out, size_t samples) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16));
+        _mm_storeu_ps(out + i, _mm_mul_ps(lo, vscale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(hi, vscale));
+    }
+#endif
+
+    for (; i < samples; ++i)
+        out[i] = in[i] * scale;
+}
+
+void S32ToFloat(const int32_t* in, float* out, size_t samples) {
+    const float scale = 1.0f / 2147483648.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vscale));
+    }
+#endif
+
+    for (; i < samples; ++i)
+        out[i] = static_cast<float>(in[i]) * scale;
+}
+
+void InterleaveFloat(const float* const* planes, int channels, float* out, size_t frames) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    if (channels == 2) {
+        const float* l = planes[0];
+        const float* r = planes[1];
+        for (; i + 4 <= frames; i += 4) {
+            __m128 vl = _mm_loadu_ps(l + i);
+            __m128 vr = _mm_loadu_ps(r + i);
+            _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(vl, vr));
+            _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(vl, vr));
+        }
+    }
+#endif
+
+    for (; i < frames; ++i)
+        for (int c = 0; c < channels; ++c)
+            out[i * channels + c] = planes[c][i];
+}
+
+void FloatToS16(const float* in, int16_t* out, size_t samples) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    // cvtps rounds to nearest, packs saturates to S16.
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    for (; i < samples; ++i)
+        out[i] = static_cast<int16_t>(std::lrint(std::clamp(in[i] * 32768.0f, -32768.0f, 32767.0f)));
+}
+
+float DotProduct(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+
+#ifdef AUDIO_MIX_SSE2
+    // Two accumulators to hide the add latency.
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+void OverlapAdd(const float* in, const float* window, float* acc, size_t frames, int channels) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            __m128 w = _mm_loadu_ps(window + i);
+            __m128 lo = _mm_mul_ps(_mm_loadu_ps(in + i * 2), _mm_unpacklo_ps(w, w));
+            __m128 hi = _mm_mul_ps(_mm_loadu_ps(in + i * 2 + 4), _mm_unpackhi_ps(w, w));
+            _mm_storeu_ps(acc + i * 2, _mm_add_ps(_mm_loadu_ps(acc + i * 2), lo));
+            _mm_storeu_ps(acc + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(acc + i * 2 + 4), hi));
+        }
+    }
+#endif
+
+    for (; i < frames; ++i)
+        for (int c = 0; c < channels; ++c)
+            acc[i * channels + c] += in[i * channels + c] * window[i];
+}
+
+void ScaleSamples(const float* in, float gain, float* out, size_t samples) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= samples; i += 8) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), g));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_loadu_ps(in + i + 4), g));
+    }
+#endif
+
+    for (; i < samples; ++i)
+        out[i] = in[i] * gain;
+}
+
+void ScaleFrames(const float* in, const float* gains, float* out, size_t frames, int channels) {
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4)
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(gains + i)));
+    } else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            __m128 g = _mm_loadu_ps(gains + i);
+            _mm_storeu_ps(out + i * 2, _mm_mul_ps(_mm_loadu_ps(in + i * 2), _mm_unpacklo_ps(g, g)));
+            _mm_storeu_ps(out + i * 2 + 4,
+                          _mm_mul_ps(_mm_loadu_ps(in + i * 2 + 4), _mm_unpackhi_ps(g, g)));
+        }
+    }
+#endif
+
+    for (; i < frames; ++i)
+        for (int c = 0; c < channels; ++c)
+            out[i * channels + c] = in[i * channels + c] * gains[i];
+}
+
+float PeakAbs(const float* in, size_t samples) {
+    size_t i = 0;
+    float peak = 0.0f;
+
+#ifdef AUDIO_MIX_SSE2
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 max0 = _mm_setzero_ps();
+    __m128 max1 = _mm_setzero_ps();
+    for (; i + 8 <= samples; i += 8) {
+        max0 = _mm_max_ps(max0, _mm_and_ps(_mm_loadu_ps(in + i), mask));
+        max1 = _mm_max_ps(max1, _mm_and_ps(_mm_loadu_ps(in + i + 4), mask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_max_ps(max0, max1));
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+
+    for (; i < samples; ++i)
+        peak = std::max(peak, std::fabs(in[i]));
+    return peak;
+}
+
+void UpsampledPeaks(const float* in, size_t frames, const float* taps, int tapCount,
+                    int phases, float* peaks) {
+    const int center = tapCount / 2 - 1;
+    size_t i = 0;
+
+#ifdef AUDIO_MIX_SSE2
+    // Four consecutive frames per pass, one in each lane.
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (; i + 4 <= frames; i += 4) {
+        __m128 peak = _mm_max_ps(_mm_loadu_ps(peaks + i),
+                                 _mm_and_ps(_mm_loadu_ps(in + i + center), mask));
+        for (int p = 0; p < phases; ++p) {
+            const float* h = taps + p * tapCount;
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < tapCount; ++k)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(h[k]), _mm_loadu_ps(in + i + k)));
+            peak = _mm_max_ps(peak, _mm_and_ps(acc, mask));
+        }
+        _mm_storeu_ps(peaks + i, peak);
+    }
+#endif
+
+    for (; i < frames; ++i) {
+        float peak = std::max(peaks[i], std::fabs(in[i + center]));
+        for (int p = 0; p < phases; ++p) {
+            const float* h = taps + p * tapCount;
+            float acc = 0.0f;
+            for (int k = 0; k < tapCount; ++k)
+                acc += h[k] * in[i + k];
+            peak = std::max(peak, std::fabs(acc));
+        }
+        peaks[i] = peak;
+    }
+}
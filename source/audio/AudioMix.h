@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class FadeCurve {
+    Linear,
+    EqualPower,
+    SCurve
+};
+
+// Fills per-frame gains for frames [pos, pos + frames) of a fade that is
+// `length` frames long. Frames past the end of the fade get 0 / 1.
+void FadeGains(FadeCurve curve, int64_t pos, int64_t length, size_t frames,
+               float* fadeOut, float* fadeIn);
+
+// out = a * gainA + b * gainB with per-frame gains. `out` may alias `a`
+// or `b`.
+void MixCrossfade(const float* a, const float* b,
+                  const float* gainA, const float* gainB,
+                  float* out, size_t frames, int channels);
+
+// Downmixes `frames` interleaved frames of `channels` channels to stereo.
+// `matrix` holds the left gains for each input channel, then the right.
+void DownmixStereo(const float* in, int channels, const float* matrix,
+                   float* out, size_t frames);
+
+// Sample format conversion to float in [-1, 1), as swresample would do it.
+void S16ToFloat(const int16_t* in, float* out, size_t samples);
+void S32ToFloat(const int32_t* in, float* out, size_t samples);
+
+// Interleaves `channels` planes of `frames` samples each.
+void InterleaveFloat(const float* const* planes, int channels, float* out, size_t frames);
+
+// Converts float samples to S16 with saturation, for devices without
+// AL_EXT_FLOAT32.
+void FloatToS16(const float* in, int16_t* out, size_t samples);
+
+// Sum of a[i] * b[i].
+float DotProduct(const float* a, const float* b, size_t n);
+
+// acc += in * window, with one window value per frame.
+void OverlapAdd(const float* in, const float* window, float* acc, size_t frames, int channels);
+
+// out = in * gain. `out` may alias `in`.
+void ScaleSamples(const float* in, float gain, float* out, size_t samples);
+// out = in * gains, with one gain per frame. `out` may alias `in`.
+void ScaleFrames(const float* in, const float* gains, float* out, size_t frames, int channels);
+
+// Largest magnitude among `samples` samples.
+float PeakAbs(const float* in, size_t samples);
+
+// Raises peaks[i] to the magnitude of in[i + tapCount / 2 - 1] and of the
+// points an upsampling filter puts after it. `taps` holds `phases` rows
+// of `tapCount` coefficients, applied to in[i] .. in[i + tapCount - 1].
+void UpsampledPeaks(const float* in, size_t frames, const float* taps, int tapCount,
+                    int phases, float* peaks);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// Where the engine's output goes. A sink is driven like an OpenAL source:
+// the engine queues numbered buffers, reclaims those that have played and
+// reads the play position within the oldest one. Every call comes from the
+// engine thread; only the wake callback may be invoked from elsewhere.
+class AudioSink {
+public:
+    enum class State {
+        Stopped,
+        Playing,
+        Paused
+    };
+
+    virtual ~AudioSink() = default;
+
+    // Buffer ids run from 0 to maxBuffers - 1. `wake` nudges the engine
+    // thread when buffers complete. Throws std::runtime_error when the
+    // output cannot be opened.
+    virtual void open(int maxBuffers, std::function<void()> wake) = 0;
+    virtual void close() = 0;
+
+    // Samples are float when true, otherwise S16.
+    virtual bool floatOutput() const = 0;
+    virtual int maxChannels() const = 0;
+    // True when the sink calls `wake` as buffers complete, so the engine
+    // never needs to poll it.
+    virtual bool wakesOnProgress() const = 0;
+    // True when output runs at the sample rate. Only then does running
+    // dry mean an audible underrun.
+    virtual bool paced() const = 0;
+
+    // Copies `frames` interleaved frames into buffer `id` and queues it.
+    virtual bool queue(int id, const void* samples, size_t frames, int channels, int sampleRate) = 0;
+    // Number of buffers played to the end since the last call. They leave
+    // the queue oldest first and their ids may be reused.
+    virtual int reclaim() = 0;
+    // Stops and drops every queued buffer without reporting it.
+    virtual void clear() = 0;
+
+    virtual void play() = 0;
+    virtual void pause() = 0;
+    // Stops; queued buffers count as played.
+    virtual void stop() = 0;
+    // A playing sink stops by itself once its queue runs out.
+    virtual State state() = 0;
+    // Frames played of the oldest queued buffer, and the output latency
+    // behind that in nanoseconds.
+    virtual int64_t position(int64_t* latencyNs) = 0;
+};
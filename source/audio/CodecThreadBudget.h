@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+// Process-wide budget of extra FFmpeg codec threads. Each open decoder
+// takes what it needs from here and gives it back on close, so overlapping
+// decoders (gapless prefetch, crossfade) do not oversubscribe the machine.
+// The player's own threads are not counted: there is a fixed handful of
+// them (output, decode, read-ahead, prefetch, GUI loaders), mostly waiting
+// on I/O, and the cores kept back below leave room for them.
+class CodecThreadBudget {
+public:
+    static CodecThreadBudget& global() {
+        // Keep two cores for the GUI and the audio output path.
+        static CodecThreadBudget budget(static_cast<int>(std::thread::hardware_concurrency()) - 2);
+        return budget;
+    }
+
+    explicit CodecThreadBudget(int limit) : m_limit(std::max(limit, 0)) {}
+
+    int limit() const { return m_limit; }
+    int inUse() const { return m_inUse.load(); }
+
+    // Grants up to `wanted` threads, possibly none. The caller must
+    // release() exactly what was granted.
+    int acquire(int wanted) {
+        if (wanted <= 0) return 0;
+        int used = m_inUse.load();
+        int granted;
+        do {
+            granted = std::clamp(m_limit - used, 0, wanted);
+            if (granted == 0) return 0;
+        } while (!m_inUse.compare_exchange_weak(used, used + granted));
+        return granted;
+    }
+
+    void release(int threads) {
+        if (threads > 0) m_inUse.fetch_sub(threads);
+    }
+
+private:
+    const int m_limit;
+    std::atomic<int> m_inUse{0};
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi-producer/single-consumer queue (Vyukov's
+// sequence-numbered array queue). Any thread may push; only the owning
+// thread pops. Cells are preallocated, so neither side allocates.
+template <typename T>
+class CommandQueue {
+public:
+    explicit CommandQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        m_cells = std::make_unique<Cell[]>(n);
+        for (size_t i = 0; i < n; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        m_mask = n - 1;
+    }
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Returns false when the queue is full.
+    bool push(const T& value) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side only.
+    bool pop(T& out) {
+        Cell& cell = m_cells[m_dequeue & m_mask];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(m_dequeue + 1) < 0)
+            return false;
+
+        out = cell.value;
+        cell.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+        ++m_dequeue;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T                   value{};
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t                  m_mask{0};
+
+    alignas(64) std::atomic<size_t> m_enqueue{0};
+    alignas(64) size_t              m_dequeue{0};
+};
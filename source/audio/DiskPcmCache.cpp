@@ -0,0 +1,321 @@
+#include "DiskPcmCache.h"
+#include <filesystem>
+#include <system_error>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char     MAGIC[4] = {'V', 'P', 'C', 'M'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t DATA_ALIGN = 64;
+
+using FileHeader = DiskPcmCache::FileHeader;
+
+uint32_t DataOffset(size_t pathBytes) {
+    size_t end = sizeof(FileHeader) + pathBytes;
+    return static_cast<uint32_t>((end + DATA_ALIGN - 1) / DATA_ALIGN * DATA_ALIGN);
+}
+
+std::FILE* OpenFile(const fs::path& path, bool write) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return std::fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+// FNV-1a, stable across builds and runs unlike std::hash.
+uint64_t HashPath(const std::string& path) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : path) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+} // namespace
+
+DiskPcmCache::Mapped::~Mapped() {
+#ifdef _WIN32
+    if (m_view) UnmapViewOfFile(m_view);
+    if (m_mapping) CloseHandle(m_mapping);
+#else
+    if (m_view) munmap(const_cast<void*>(m_view), m_viewSize);
+#endif
+}
+
+DiskPcmCache::Writer::~Writer() {
+    if (!m_file) return;
+    std::fclose(m_file);
+    std::error_code ec;
+    fs::remove(fs::u8path(m_tmpPath), ec);
+}
+
+bool DiskPcmCache::Writer::append(const float* samples, size_t count) {
+    if (!m_file || m_samples + count > m_maxSamples) return false;
+    if (std::fwrite(samples, sizeof(float), count, m_file) != count) return false;
+    m_samples += count;
+    return true;
+}
+
+void DiskPcmCache::Writer::commit() {
+    if (!m_file) return;
+
+    m_header.frames = m_samples / m_header.channels;
+    bool ok = std::fseek(m_file, 0, SEEK_SET) == 0 &&
+              std::fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+    ok = std::fclose(m_file) == 0 && ok;
+    m_file = nullptr;
+
+    std::error_code ec;
+    if (ok) fs::rename(fs::u8path(m_tmpPath), fs::u8path(m_finalPath), ec);
+    if (!ok || ec) {
+        fs::remove(fs::u8path(m_tmpPath), ec);
+        return;
+    }
+
+    m_cache->m_writes.fetch_add(1);
+    m_cache->trim();
+}
+
+DiskPcmCache::DiskPcmCache(std::string directory, uint64_t maxBytes)
+    : m_directory(std::move(directory)), m_maxBytes(maxBytes) {}
+
+void DiskPcmCache::configure(const std::string& directory, uint64_t maxBytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_directory = directory;
+        m_maxBytes = maxBytes;
+    }
+    if (maxBytes > 0) trim();
+}
+
+DiskPcmCache::Stats DiskPcmCache::stats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.maxBytes = m_maxBytes;
+    }
+    stats.hits = m_hits.load();
+    stats.misses = m_misses.load();
+    stats.writes = m_writes.load();
+    stats.evictions = m_evictions.load();
+    stats.invalid = m_invalid.load();
+    return stats;
+}
+
+std::string DiskPcmCache::fileFor(const std::string& path) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.pcm",
+                  static_cast<unsigned long long>(HashPath(path)));
+    return (fs::u8path(m_directory) / name).u8string();
+}
+
+std::shared_ptr<const DiskPcmCache::Mapped> DiskPcmCache::find(const std::string& path,
+                                                               const SourceStamp& stamp) {
+    std::string file;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_maxBytes == 0 || m_directory.empty()) return nullptr;
+        file = fileFor(path);
+    }
+    if (!stamp.valid) {
+        m_misses.fetch_add(1);
+        return nullptr;
+    }
+
+    std::shared_ptr<Mapped> mapped(new Mapped());
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(fs::u8path(file).c_str(), GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        m_misses.fetch_add(1);
+        return nullptr;
+    }
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+        mapped->m_mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapped->m_mapping)
+            mapped->m_view = MapViewOfFile(mapped->m_mapping, FILE_MAP_READ, 0, 0, 0);
+        mapped->m_viewSize = static_cast<size_t>(size.QuadPart);
+    }
+    CloseHandle(handle);
+#else
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_misses.fetch_add(1);
+        return nullptr;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (view != MAP_FAILED) {
+            madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            mapped->m_view = view;
+            mapped->m_viewSize = static_cast<size_t>(st.st_size);
+        }
+    }
+    ::close(fd);
+#endif
+
+    // Anything that does not match the source exactly is dropped.
+    bool valid = false;
+    if (mapped->m_view && mapped->m_viewSize >= sizeof(FileHeader)) {
+        FileHeader header;
+        std::memcpy(&header, mapped->m_view, sizeof(header));
+        const char* base = static_cast<const char*>(mapped->m_view);
+        valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                header.version == VERSION &&
+                header.sampleRate > 0 &&
+                header.channels > 0 && header.channels <= 8 &&
+                header.sourceSize == stamp.size &&
+                header.sourceMtime == stamp.mtime &&
+                header.pathBytes == path.size() &&
+                header.dataOffset == DataOffset(path.size()) &&
+                mapped->m_viewSize == header.dataOffset +
+                    header.frames * header.channels * sizeof(float) &&
+                std::memcmp(base + sizeof(FileHeader), path.data(), path.size()) == 0;
+        if (valid) {
+            mapped->m_samples = reinterpret_cast<const float*>(base + header.dataOffset);
+            mapped->m_frames = static_cast<size_t>(header.frames);
+            mapped->m_channels = static_cast<int>(header.channels);
+            mapped->m_sampleRate = static_cast<int>(header.sampleRate);
+        }
+    }
+
+    std::error_code ec;
+    if (!valid) {
+        mapped.reset();
+        fs::remove(fs::u8path(file), ec);
+        m_invalid.fetch_add(1);
+        m_misses.fetch_add(1);
+        return nullptr;
+    }
+
+    // The file's mtime doubles as its last use for eviction.
+    fs::last_write_time(fs::u8path(file), fs::file_time_type::clock::now(), ec);
+    m_hits.fetch_add(1);
+    return mapped;
+}
+
+std::unique_ptr<DiskPcmCache::Writer> DiskPcmCache::beginWrite(const std::string& path,
+                                                               const SourceStamp& stamp,
+                                                               int sampleRate, int channels,
+                                                               double duration) {
+    std::string directory;
+    uint64_t maxBytes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        directory = m_directory;
+        maxBytes = m_maxBytes;
+    }
+    if (maxBytes == 0 || directory.empty() || !stamp.valid || sampleRate <= 0 || channels <= 0)
+        return nullptr;
+
+    // One track may take at most a quarter of the cache.
+    uint64_t maxSamples = maxBytes / 4 / sizeof(float);
+    if (duration * sampleRate * channels > static_cast<double>(maxSamples)) return nullptr;
+
+    std::error_code ec;
+    fs::create_directories(fs::u8path(directory), ec);
+
+    std::unique_ptr<Writer> writer(new Writer());
+    writer->m_cache = this;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        writer->m_finalPath = fileFor(path);
+    }
+    writer->m_tmpPath = writer->m_finalPath + "." +
+                        std::to_string(reinterpret_cast<uintptr_t>(writer.get())) + ".tmp";
+    writer->m_maxSamples = maxSamples;
+
+    FileHeader& header = writer->m_header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sampleRate = static_cast<uint32_t>(sampleRate);
+    header.channels = static_cast<uint32_t>(channels);
+    header.frames = 0;
+    header.sourceSize = stamp.size;
+    header.sourceMtime = stamp.mtime;
+    header.pathBytes = static_cast<uint32_t>(path.size());
+    header.dataOffset = DataOffset(path.size());
+
+    writer->m_file = OpenFile(fs::u8path(writer->m_tmpPath), true);
+    if (!writer->m_file) return nullptr;
+
+    // The header is rewritten with the frame count on commit.
+    std::vector<char> preamble(header.dataOffset, 0);
+    std::memcpy(preamble.data(), &header, sizeof(header));
+    std::memcpy(preamble.data() + sizeof(header), path.data(), path.size());
+    if (std::fwrite(preamble.data(), 1, preamble.size(), writer->m_file) != preamble.size())
+        return nullptr;
+    return writer;
+}
+
+void DiskPcmCache::trim() {
+    std::string directory;
+    uint64_t maxBytes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        directory = m_directory;
+        maxBytes = m_maxBytes;
+    }
+
+    struct CacheFile {
+        fs::path           path;
+        uint64_t           size;
+        fs::file_time_type used;
+    };
+    std::vector<CacheFile> files;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    auto staleBefore = fs::file_time_type::clock::now() - std::chrono::hours(24);
+    for (fs::directory_iterator it(fs::u8path(directory), ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code fileEc;
+        if (!it->is_regular_file(fileEc)) continue;
+        auto used = it->last_write_time(fileEc);
+        if (fileEc) continue;
+
+        // Leftovers of writes that never finished.
+        if (it->path().extension() == ".tmp") {
+            if (used < staleBefore) fs::remove(it->path(), fileEc);
+            continue;
+        }
+        if (it->path().extension() != ".pcm") continue;
+
+        uint64_t size = it->file_size(fileEc);
+        if (fileEc) continue;
+        files.push_back({it->path(), size, used});
+        total += size;
+    }
+    if (total <= maxBytes) return;
+
+    std::sort(files.begin(), files.end(),
+              [](const CacheFile& a, const CacheFile& b) { return a.used < b.used; });
+    for (const CacheFile& file : files) {
+        if (total <= maxBytes) break;
+        // Files still mapped by a reader cannot be removed on Windows.
+        std::error_code removeEc;
+        if (fs::remove(file.path, removeEc)) {
+            total -= file.size;
+            m_evictions.fetch_add(1);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include "PcmCache.h"
+
+// Persistent cache of decoded tracks: one file per track holding a small
+// header and raw interleaved float frames. Hits are memory-mapped, so a
+// replay streams from the page cache without any decoding. Files are
+// validated against the source's size and mtime and the directory is kept
+// under a size cap by evicting the least recently used files.
+class DiskPcmCache {
+public:
+    // File layout: this header, the UTF-8 source path, zero padding up to
+    // dataOffset, then frames * channels floats.
+    struct FileHeader {
+        char     magic[4];
+        uint32_t version;
+        uint32_t sampleRate;
+        uint32_t channels;
+        uint64_t frames;
+        uint64_t sourceSize;
+        int64_t  sourceMtime;
+        uint32_t pathBytes;
+        uint32_t dataOffset;
+    };
+
+    // A read-only mapping of one cached track.
+    class Mapped {
+    public:
+        ~Mapped();
+        Mapped(const Mapped&) = delete;
+        Mapped& operator=(const Mapped&) = delete;
+
+        const float* samples() const { return m_samples; }
+        size_t frames() const { return m_frames; }
+        int channels() const { return m_channels; }
+        int sampleRate() const { return m_sampleRate; }
+
+    private:
+        friend class DiskPcmCache;
+        Mapped() = default;
+
+        const void*  m_view{nullptr};
+        size_t       m_viewSize{0};
+#ifdef _WIN32
+        void*        m_mapping{nullptr};
+#endif
+        const float* m_samples{nullptr};
+        size_t       m_frames{0};
+        int          m_channels{0};
+        int          m_sampleRate{0};
+    };
+
+    // Streams a track into the cache while it is decoded. Nothing becomes
+    // visible until commit(); a writer destroyed without it leaves no file.
+    class Writer {
+    public:
+        ~Writer();
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        bool append(const float* samples, size_t count);
+        void commit();
+
+    private:
+        friend class DiskPcmCache;
+        Writer() = default;
+
+        DiskPcmCache* m_cache{nullptr};
+        std::FILE*    m_file{nullptr};
+        std::string   m_tmpPath;
+        std::string   m_finalPath;
+        FileHeader    m_header{};
+        uint64_t      m_samples{0};
+        uint64_t      m_maxSamples{0};
+    };
+
+    struct Stats {
+        uint64_t maxBytes{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t writes{0};
+        uint64_t evictions{0};
+        uint64_t invalid{0};
+    };
+
+    DiskPcmCache(std::string directory, uint64_t maxBytes);
+
+    DiskPcmCache(const DiskPcmCache&) = delete;
+    DiskPcmCache& operator=(const DiskPcmCache&) = delete;
+
+    // maxBytes == 0 disables the cache.
+    void configure(const std::string& directory, uint64_t maxBytes);
+    Stats stats() const;
+
+    std::shared_ptr<const Mapped> find(const std::string& path, const SourceStamp& stamp);
+    // Null when the cache is disabled or the track would not fit.
+    std::unique_ptr<Writer> beginWrite(const std::string& path, const SourceStamp& stamp,
+                                       int sampleRate, int channels, double duration);
+
+private:
+    std::string fileFor(const std::string& path) const;
+    void trim();
+
+    mutable std::mutex m_mutex;
+    std::string        m_directory;
+    uint64_t           m_maxBytes{0};
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_writes{0};
+    std::atomic<uint64_t> m_evictions{0};
+    std::atomic<uint64_t> m_invalid{0};
+};
@@ -0,0 +1,148 @@
+#include "FileSink.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint16_t WAVE_FORMAT_PCM        = 0x0001;
+constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// Speaker masks for the layouts the engine produces, in the same order as
+// the AL_EXT_MCFORMATS formats.
+uint32_t ChannelMask(int channels) {
+    switch (channels) {
+    case 1:  return 0x4;    // FC
+    case 2:  return 0x3;    // FL FR
+    case 4:  return 0x33;   // FL FR BL BR
+    case 6:  return 0x60F;  // FL FR FC LFE SL SR
+    case 8:  return 0x63F;  // FL FR FC LFE BL BR SL SR
+    default: return 0;
+    }
+}
+
+void Put16(uint8_t*& p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p += 2;
+}
+
+void Put32(uint8_t*& p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+    p += 4;
+}
+
+void PutTag(uint8_t*& p, const char* tag) {
+    std::memcpy(p, tag, 4);
+    p += 4;
+}
+
+std::FILE* OpenFile(const fs::path& path) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), L"wb");
+#else
+    return std::fopen(path.c_str(), "wb");
+#endif
+}
+
+} // namespace
+
+FileSink::FileSink(std::string path, Format format, bool float32, bool paced)
+    : NullSink(paced), m_path(std::move(path)), m_format(format), m_float(float32) {
+    keepSamples(true);
+}
+
+void FileSink::open(int maxBuffers, std::function<void()> wake) {
+    close();
+    NullSink::open(maxBuffers, std::move(wake));
+
+    m_file = OpenFile(fs::u8path(m_path));
+    if (!m_file) throw std::runtime_error("Failed to create output file: " + m_path);
+    m_channels = 0;
+    m_sampleRate = 0;
+    m_dataBytes = 0;
+    m_warned = false;
+}
+
+void FileSink::close() {
+    NullSink::close();
+    if (!m_file) return;
+
+    if (m_format == Format::Wav && m_channels > 0) {
+        std::fseek(m_file, 0, SEEK_SET);
+        writeHeader();
+    }
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+void FileSink::played(const void* samples, size_t frames, int channels, int sampleRate) {
+    if (!m_file || !samples) return;
+
+    if (m_channels == 0) {
+        m_channels = channels;
+        m_sampleRate = sampleRate;
+        // Sizes are filled in on close.
+        if (m_format == Format::Wav && !writeHeader()) {
+            std::cerr << "Failed to write WAV header: " << m_path << "\n";
+            return;
+        }
+    } else if (m_format == Format::Wav && (channels != m_channels || sampleRate != m_sampleRate)) {
+        if (!m_warned)
+            std::cerr << "Output format changed, not written to " << m_path << "\n";
+        m_warned = true;
+        return;
+    }
+
+    size_t bytes = frames * channels * (m_float ? sizeof(float) : sizeof(int16_t));
+    if (std::fwrite(samples, 1, bytes, m_file) != bytes) {
+        std::cerr << "Failed to write " << m_path << "\n";
+        return;
+    }
+    m_dataBytes += bytes;
+}
+
+bool FileSink::writeHeader() {
+    const bool extensible = m_channels > 2;
+    const uint16_t bits = m_float ? 32 : 16;
+    const uint16_t blockAlign = static_cast<uint16_t>(m_channels * bits / 8);
+    const uint32_t fmtBytes = extensible ? 40 : 16;
+    // RIFF sizes are 32-bit; longer renders get saturated sizes.
+    const uint32_t dataBytes = static_cast<uint32_t>(
+        std::min<uint64_t>(m_dataBytes, 0xFFFFFFFFu - 64));
+
+    uint8_t header[68];
+    uint8_t* p = header;
+    PutTag(p, "RIFF");
+    Put32(p, 4 + 8 + fmtBytes + 8 + dataBytes);
+    PutTag(p, "WAVE");
+    PutTag(p, "fmt ");
+    Put32(p, fmtBytes);
+    Put16(p, extensible ? WAVE_FORMAT_EXTENSIBLE : m_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    Put16(p, static_cast<uint16_t>(m_channels));
+    Put32(p, static_cast<uint32_t>(m_sampleRate));
+    Put32(p, static_cast<uint32_t>(m_sampleRate) * blockAlign);
+    Put16(p, blockAlign);
+    Put16(p, bits);
+    if (extensible) {
+        Put16(p, 22);
+        Put16(p, bits);
+        Put32(p, ChannelMask(m_channels));
+        // KSDATAFORMAT_SUBTYPE_PCM or _IEEE_FLOAT.
+        static const uint8_t guidTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                             0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        Put16(p, m_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+        std::memcpy(p, guidTail, sizeof(guidTail));
+        p += sizeof(guidTail);
+    }
+    PutTag(p, "data");
+    Put32(p, dataBytes);
+
+    size_t size = static_cast<size_t>(p - header);
+    return std::fwrite(header, 1, size, m_file) == size;
+}
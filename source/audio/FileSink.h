@@ -0,0 +1,45 @@
+#pragma once
+
+#include "NullSink.h"
+#include <cstdio>
+#include <string>
+
+// Writes what would have been heard to a WAV or headerless PCM file, with
+// the volume applied. Runs as fast as the engine produces audio unless
+// paced. A WAV file keeps the format of its first buffer; later buffers
+// in another format are left out of it.
+class FileSink : public NullSink {
+public:
+    enum class Format {
+        Wav,
+        Raw
+    };
+
+    explicit FileSink(std::string path, Format format = Format::Wav,
+                      bool float32 = true, bool paced = false);
+    ~FileSink() override { close(); }
+
+    // Throws std::runtime_error when the file cannot be created.
+    void open(int maxBuffers, std::function<void()> wake) override;
+    // Finishes the WAV header.
+    void close() override;
+
+    bool floatOutput() const override { return m_float; }
+
+    uint64_t bytesWritten() const { return m_dataBytes; }
+
+protected:
+    void played(const void* samples, size_t frames, int channels, int sampleRate) override;
+
+private:
+    bool writeHeader();
+
+    std::string m_path;
+    Format      m_format{Format::Wav};
+    bool        m_float{true};
+    std::FILE*  m_file{nullptr};
+    int         m_channels{0};
+    int         m_sampleRate{0};
+    uint64_t    m_dataBytes{0};
+    bool        m_warned{false};
+};
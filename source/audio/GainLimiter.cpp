@@ -0,0 +1,252 @@
+#include "GainLimiter.h"
+#include "AudioMix.h"
+#include "Realtime.h"
+#include <algorithm>
+#include <cmath>
+
+GainLimiter::GainLimiter() {
+    // Windowed-sinc phases for the points a quarter, half and three
+    // quarters of a frame after the centre sample, each with unity DC gain.
+    const int center = TAPS / 2 - 1;
+    for (int p = 0; p < PHASES; ++p) {
+        float* h = m_taps + p * TAPS;
+        double sum = 0.0;
+        for (int k = 0; k < TAPS; ++k) {
+            double t = center + (p + 1) / 4.0 - k;
+            double sinc = std::sin(M_PI * t) / (M_PI * t);
+            double window = 0.5 * (1.0 + std::cos(M_PI * t / (TAPS / 2)));
+            h[k] = static_cast<float>(sinc * window);
+            sum += h[k];
+        }
+        float overshoot = 0.0f;
+        for (int k = 0; k < TAPS; ++k) {
+            h[k] = static_cast<float>(h[k] / sum);
+            overshoot += std::fabs(h[k]);
+        }
+        m_overshoot = std::max(m_overshoot, overshoot);
+    }
+}
+
+void GainLimiter::configure(int sampleRate, int channels, size_t maxFrames) {
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_lookahead = std::max<size_t>(1, static_cast<size_t>(std::lround(sampleRate * LOOKAHEAD_SECONDS)));
+    m_delay = m_lookahead + PEAK_LAG;
+    m_release = static_cast<float>(std::exp(-1.0 / (RELEASE_SECONDS * sampleRate)));
+
+    m_work.assign((m_delay + maxFrames) * channels, 0.0f);
+    m_historyStride = TAPS - 1 + maxFrames;
+    m_history.assign(m_historyStride * channels, 0.0f);
+    m_peaks.resize(maxFrames);
+    m_gains.resize(maxFrames);
+    m_ramp.resize(maxFrames);
+    size_t capacity = 1;
+    while (capacity < m_lookahead + 1) capacity <<= 1;
+    m_hold.resize(capacity);
+    m_box.resize(m_lookahead + 1);
+    reset();
+}
+
+bool GainLimiter::lockMemory(MemoryLock& lock) const {
+    bool locked = lock.add(m_work.data(), m_work.capacity() * sizeof(float));
+    locked &= lock.add(m_history.data(), m_history.capacity() * sizeof(float));
+    locked &= lock.add(m_peaks.data(), m_peaks.capacity() * sizeof(float));
+    locked &= lock.add(m_gains.data(), m_gains.capacity() * sizeof(float));
+    locked &= lock.add(m_ramp.data(), m_ramp.capacity() * sizeof(float));
+    locked &= lock.add(m_hold.data(), m_hold.capacity() * sizeof(Hold));
+    locked &= lock.add(m_box.data(), m_box.capacity() * sizeof(float));
+    return locked;
+}
+
+void GainLimiter::reset() {
+    std::fill(m_work.begin(), m_work.end(), 0.0f);
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    m_holdHead = 0;
+    m_holdCount = 0;
+    std::fill(m_box.begin(), m_box.end(), 1.0f);
+    m_boxPos = 0;
+    m_boxSum = static_cast<double>(m_box.size());
+    m_env = 1.0f;
+    m_quietRun = 0;
+    m_idle = true;
+    m_lastQuiet = true;
+
+    // A pending ramp has nothing left to smooth.
+    m_gain = m_target;
+    m_rampLeft = 0;
+}
+
+void GainLimiter::setGain(float gain, bool immediate) {
+    m_target = gain;
+    if (immediate || m_sampleRate <= 0) {
+        m_gain = gain;
+        m_rampLeft = 0;
+        return;
+    }
+    m_rampLeft = std::max<size_t>(1, static_cast<size_t>(RAMP_SECONDS * m_sampleRate));
+    m_step = (gain - m_gain) / m_rampLeft;
+}
+
+void GainLimiter::process(const float* in, float* out, size_t frames) {
+    applyGain(in, m_work.data() + m_delay * m_channels, frames);
+    run(out, frames);
+}
+
+size_t GainLimiter::flush(float* out) {
+    const size_t frames = m_delay;
+    std::fill_n(m_work.data() + m_delay * m_channels, frames * m_channels, 0.0f);
+    run(out, frames);
+    reset();
+    return frames;
+}
+
+void GainLimiter::run(float* out, size_t frames) {
+    const size_t channels = static_cast<size_t>(m_channels);
+    const float* block = m_work.data() + m_delay * channels;
+
+    // Sample peaks bound the interpolated ones through the filter's gain,
+    // so a quiet block needs no per-frame look, provided the previous one
+    // was quiet too: the first points interpolated here reach back into it.
+    bool quiet = PeakAbs(block, frames * channels) * m_overshoot <= CEILING;
+    bool wasQuiet = m_lastQuiet;
+    m_lastQuiet = quiet;
+    if (quiet && wasQuiet && m_idle) {
+        keepHistory(block, frames);
+        std::copy_n(m_work.data(), frames * channels, out);
+    } else {
+        if (quiet) {
+            const size_t head = std::min<size_t>(frames, TAPS - 1);
+            findPeaks(block, head);
+            keepHistory(block + head * channels, frames - head);
+            std::fill(m_peaks.begin() + head, m_peaks.begin() + frames, 0.0f);
+        } else {
+            findPeaks(block, frames);
+        }
+        computeGains(frames);
+        ScaleFrames(m_work.data(), m_gains.data(), out, frames, m_channels);
+    }
+
+    // The last frames wait for the next block.
+    std::copy(m_work.begin() + frames * channels, m_work.begin() + (frames + m_delay) * channels,
+              m_work.begin());
+}
+
+GainLimiter::Stats GainLimiter::stats() const {
+    Stats stats;
+    stats.limitedFrames = m_limitedFrames.load();
+    stats.maxReductionDb = 20.0f * std::log10(1.0f / m_minGain.load());
+    return stats;
+}
+
+void GainLimiter::applyGain(const float* in, float* out, size_t frames) {
+    const size_t channels = static_cast<size_t>(m_channels);
+    size_t ramped = std::min(frames, m_rampLeft);
+    if (ramped > 0) {
+        for (size_t i = 0; i < ramped; ++i) {
+            m_gain += m_step;
+            m_ramp[i] = m_gain;
+        }
+        ScaleFrames(in, m_ramp.data(), out, ramped, m_channels);
+        m_rampLeft -= ramped;
+        if (m_rampLeft == 0) m_gain = m_target;
+    }
+    ScaleSamples(in + ramped * channels, m_gain, out + ramped * channels,
+                 (frames - ramped) * channels);
+}
+
+void GainLimiter::findPeaks(const float* block, size_t frames) {
+    const size_t channels = static_cast<size_t>(m_channels);
+    const size_t kept = TAPS - 1;
+    std::fill_n(m_peaks.data(), frames, 0.0f);
+    for (size_t c = 0; c < channels; ++c) {
+        float* history = m_history.data() + c * m_historyStride;
+        for (size_t i = 0; i < frames; ++i)
+            history[kept + i] = block[i * channels + c];
+        UpsampledPeaks(history, frames, m_taps, TAPS, PHASES, m_peaks.data());
+        std::copy_n(history + frames, kept, history);
+    }
+}
+
+void GainLimiter::keepHistory(const float* block, size_t frames) {
+    const size_t channels = static_cast<size_t>(m_channels);
+    const size_t kept = TAPS - 1;
+    for (size_t c = 0; c < channels; ++c) {
+        float* history = m_history.data() + c * m_historyStride;
+        size_t from = 0;
+        if (frames < kept) {
+            std::copy(history + frames, history + kept, history);
+        } else {
+            from = frames - kept;
+        }
+        float* dst = history + kept - (frames - from);
+        for (size_t i = from; i < frames; ++i)
+            *dst++ = block[i * channels + c];
+    }
+}
+
+void GainLimiter::computeGains(size_t frames) {
+    const size_t window = m_lookahead + 1;
+    const double scale = 1.0 / window;
+    const size_t mask = m_hold.size() - 1;
+    Hold* holds = m_hold.data();
+    float* box = m_box.data();
+    const float* peaks = m_peaks.data();
+    float* gains = m_gains.data();
+
+    // Locals, so the compiler keeps the state in registers.
+    size_t head = m_holdHead, count = m_holdCount, pos = m_boxPos;
+    uint64_t index = m_index, quietRun = m_quietRun;
+    double sum = m_boxSum;
+    float env = m_env;
+    uint64_t limited = 0;
+    float minGain = 1.0f;
+
+    for (size_t i = 0; i < frames; ++i, ++index) {
+        float need = peaks[i] > CEILING ? CEILING / peaks[i] : 1.0f;
+
+        // Smallest needed gain in the window, kept as an increasing ring.
+        if (count > 0 && holds[head].index + window <= index) {
+            head = (head + 1) & mask;
+            --count;
+        }
+        while (count > 0 && holds[(head + count - 1) & mask].gain >= need)
+            --count;
+        holds[(head + count) & mask] = {index, need};
+        ++count;
+        float hold = holds[head].gain;
+
+        // Instant attack, exponential release.
+        env = hold < env ? hold : hold + (env - hold) * m_release;
+        if (env > 0.99999f) env = 1.0f;
+
+        // Averaging the held envelope over the window fades the gain in
+        // over the lookahead, and it still reaches `hold` at the peak.
+        sum += env - box[pos];
+        box[pos] = env;
+        pos = pos + 1 == window ? 0 : pos + 1;
+        float gain = static_cast<float>(sum * scale);
+        gains[i] = gain;
+
+        if (gain < 0.9999f) ++limited;
+        minGain = std::min(minGain, gain);
+        quietRun = need == 1.0f && env == 1.0f ? quietRun + 1 : 0;
+    }
+
+    m_holdHead = head;
+    m_holdCount = count;
+    m_boxPos = pos;
+    m_index = index;
+    m_quietRun = quietRun;
+    m_boxSum = sum;
+    m_env = env;
+
+    // Once both windows hold nothing but unity, go back to the fast path.
+    m_idle = m_quietRun >= 2 * window;
+    if (m_idle) {
+        std::fill(m_box.begin(), m_box.end(), 1.0f);
+        m_boxSum = static_cast<double>(window);
+    }
+
+    if (limited > 0) m_limitedFrames.fetch_add(limited);
+    if (minGain < m_minGain.load()) m_minGain.store(minGain);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class MemoryLock;
+
+// Output volume followed by a lookahead true-peak limiter. Volume changes
+// are ramped sample by sample over 20 ms, so slider steps do not zipper.
+// The limiter estimates inter-sample peaks with a 4x polyphase
+// interpolator and only acts on those above 0 dBFS: the gain each needs is
+// reached by the time it plays, 2 ms later, and released over 50 ms.
+// Blocks that cannot reach the ceiling skip the per-frame work.
+class GainLimiter {
+public:
+    static constexpr float  CEILING           = 1.0f;
+    static constexpr double LOOKAHEAD_SECONDS = 0.002;
+    static constexpr double RELEASE_SECONDS   = 0.05;
+    static constexpr double RAMP_SECONDS      = 0.02;
+
+    struct Stats {
+        uint64_t limitedFrames{0};
+        float    maxReductionDb{0.0f};
+    };
+
+    GainLimiter();
+
+    // Sizes every buffer for blocks of up to `maxFrames` and resets. Only
+    // reallocates when a format needs more room than any before it.
+    void configure(int sampleRate, int channels, size_t maxFrames);
+    // Pins the working buffers for real-time output.
+    bool lockMemory(MemoryLock& lock) const;
+    // Drops the lookahead delay and any gain reduction.
+    void reset();
+
+    // Ramps to `gain`, or jumps when `immediate`.
+    void setGain(float gain, bool immediate = false);
+    float gain() const { return m_target; }
+
+    int sampleRate() const { return m_sampleRate; }
+    int channels() const { return m_channels; }
+    // Output trails input by this many frames.
+    size_t latency() const { return m_delay; }
+
+    // `out` must not alias `in`.
+    void process(const float* in, float* out, size_t frames);
+    // Writes the latency() frames still held back, as if silence followed,
+    // and resets. For the end of the stream and before configure().
+    size_t flush(float* out);
+
+    // Safe to call from any thread.
+    Stats stats() const;
+
+private:
+    static constexpr int TAPS   = 12;
+    static constexpr int PHASES = 3;
+    // Frames from the newest input to the sample the interpolator centres on.
+    static constexpr size_t PEAK_LAG = TAPS / 2;
+
+    void run(float* out, size_t frames);
+    void applyGain(const float* in, float* out, size_t frames);
+    void findPeaks(const float* block, size_t frames);
+    void keepHistory(const float* block, size_t frames);
+    void computeGains(size_t frames);
+
+    int    m_sampleRate{0};
+    int    m_channels{0};
+    size_t m_lookahead{0};
+    size_t m_delay{0};
+    float  m_release{0.0f};
+
+    float  m_gain{1.0f};
+    float  m_target{1.0f};
+    float  m_step{0.0f};
+    size_t m_rampLeft{0};
+
+    float  m_taps[PHASES * TAPS];
+    float  m_overshoot{1.0f};  // most an interpolated point can exceed its neighbours by
+
+    // The delayed frames, then the current block with the volume applied.
+    std::vector<float> m_work;
+    // Per channel, m_historyStride apart: TAPS - 1 frames of history,
+    // then the current block.
+    std::vector<float> m_history;
+    size_t             m_historyStride{0};
+    std::vector<float> m_peaks;
+    std::vector<float> m_gains;
+    std::vector<float> m_ramp;
+
+    // Sliding minimum of the needed gain over the lookahead window, as a
+    // ring of increasing values, then a moving average of the released
+    // envelope over the same window.
+    struct Hold {
+        uint64_t index;
+        float    gain;
+    };
+    std::vector<Hold>  m_hold;
+    size_t   m_holdHead{0};
+    size_t   m_holdCount{0};
+    std::vector<float> m_box;
+    size_t   m_boxPos{0};
+    double   m_boxSum{0.0};
+    float    m_env{1.0f};
+    uint64_t m_index{0};
+    uint64_t m_quietRun{0};
+    bool     m_idle{true};
+    bool     m_lastQuiet{true};
+
+    std::atomic<uint64_t> m_limitedFrames{0};
+    std::atomic<float>    m_minGain{1.0f};
+};
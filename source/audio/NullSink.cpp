@@ -0,0 +1,109 @@
+#include "NullSink.h"
+#include "PlaybackClock.h"
+#include <algorithm>
+
+void NullSink::open(int maxBuffers, std::function<void()>) {
+    m_buffers.assign(maxBuffers, Buffer{});
+    m_framesPlayed.store(0);
+    clear();
+}
+
+void NullSink::close() {
+    clear();
+    m_buffers.clear();
+}
+
+bool NullSink::queue(int id, const void* samples, size_t frames, int channels, int sampleRate) {
+    Buffer& buf = m_buffers[id];
+    buf.frames = frames;
+    buf.channels = channels;
+    buf.sampleRate = sampleRate;
+    if (m_keepSamples) {
+        const auto* bytes = static_cast<const uint8_t*>(samples);
+        size_t size = frames * channels * (floatOutput() ? sizeof(float) : sizeof(int16_t));
+        buf.samples.assign(bytes, bytes + size);
+    }
+    m_queue.push_back(id);
+    return true;
+}
+
+int NullSink::reclaim() {
+    if (!m_paced && m_state == State::Playing) {
+        while (!m_queue.empty()) finishHead();
+    }
+    advance();
+
+    int done = m_done;
+    m_done = 0;
+    return done;
+}
+
+void NullSink::clear() {
+    m_queue.clear();
+    m_done = 0;
+    m_state = State::Stopped;
+    m_headOffsetNs = 0;
+}
+
+void NullSink::play() {
+    if (m_state == State::Playing) return;
+    // Like an AL source, one with nothing queued stops at once.
+    m_state = m_queue.empty() ? State::Stopped : State::Playing;
+    m_headStartNs = PlaybackClock::nowNs() - m_headOffsetNs;
+    m_headOffsetNs = 0;
+}
+
+void NullSink::pause() {
+    advance();
+    if (m_state != State::Playing) return;
+    m_headOffsetNs = PlaybackClock::nowNs() - m_headStartNs;
+    m_state = State::Paused;
+}
+
+void NullSink::stop() {
+    m_done += static_cast<int>(m_queue.size());
+    m_queue.clear();
+    m_state = State::Stopped;
+    m_headOffsetNs = 0;
+}
+
+AudioSink::State NullSink::state() {
+    advance();
+    return m_state;
+}
+
+int64_t NullSink::position(int64_t* latencyNs) {
+    advance();
+    if (latencyNs) *latencyNs = 0;
+    if (!m_paced || m_queue.empty() || m_state == State::Stopped) return 0;
+
+    const Buffer& head = m_buffers[m_queue.front()];
+    int64_t elapsed = m_state == State::Playing ? PlaybackClock::nowNs() - m_headStartNs
+                                                : m_headOffsetNs;
+    int64_t frames = elapsed * head.sampleRate / 1000000000;
+    return std::clamp<int64_t>(frames, 0, static_cast<int64_t>(head.frames));
+}
+
+void NullSink::advance() {
+    if (m_state != State::Playing) return;
+
+    if (m_paced) {
+        int64_t now = PlaybackClock::nowNs();
+        while (!m_queue.empty()) {
+            const Buffer& head = m_buffers[m_queue.front()];
+            int64_t length = static_cast<int64_t>(head.frames) * 1000000000 / head.sampleRate;
+            if (now - m_headStartNs < length) break;
+            m_headStartNs += length;
+            finishHead();
+        }
+    }
+    if (m_queue.empty()) m_state = State::Stopped;
+}
+
+void NullSink::finishHead() {
+    const Buffer& head = m_buffers[m_queue.front()];
+    played(m_keepSamples ? head.samples.data() : nullptr, head.frames, head.channels, head.sampleRate);
+    m_framesPlayed.fetch_add(head.frames);
+    m_queue.pop_front();
+    ++m_done;
+}
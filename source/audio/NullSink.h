@@ -0,0 +1,66 @@
+#pragma once
+
+#include "AudioSink.h"
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// Output without a device, for headless machines, benchmarks and
+// regression runs. Unpaced, every queued buffer counts as played the next
+// time the engine reclaims, so playback runs as fast as decoding allows.
+// Paced, buffers play out in real time on the steady clock.
+class NullSink : public AudioSink {
+public:
+    explicit NullSink(bool paced = false) : m_paced(paced) {}
+
+    void open(int maxBuffers, std::function<void()> wake) override;
+    void close() override;
+
+    bool floatOutput() const override { return true; }
+    int maxChannels() const override { return 8; }
+    bool wakesOnProgress() const override { return false; }
+    bool paced() const override { return m_paced; }
+
+    bool queue(int id, const void* samples, size_t frames, int channels, int sampleRate) override;
+    int reclaim() override;
+    void clear() override;
+
+    void play() override;
+    void pause() override;
+    void stop() override;
+    State state() override;
+    int64_t position(int64_t* latencyNs) override;
+
+    // Frames played to the end since open; safe from any thread.
+    uint64_t framesPlayed() const { return m_framesPlayed.load(); }
+
+protected:
+    // Called for each buffer that plays to its end. Samples are only
+    // passed when keepSamples() was set, otherwise null.
+    virtual void played(const void*, size_t, int, int) {}
+    void keepSamples(bool keep) { m_keepSamples = keep; }
+
+private:
+    struct Buffer {
+        size_t               frames{0};
+        int                  channels{2};
+        int                  sampleRate{0};
+        std::vector<uint8_t> samples;
+    };
+
+    void advance();
+    void finishHead();
+
+    bool   m_paced{false};
+    bool   m_keepSamples{false};
+    State  m_state{State::Stopped};
+
+    std::vector<Buffer> m_buffers;
+    std::deque<int>     m_queue;
+    int                 m_done{0};
+    // Steady-clock time the head buffer started playing, or while not
+    // playing, how far into it playback had got.
+    int64_t             m_headStartNs{0};
+    int64_t             m_headOffsetNs{0};
+    std::atomic<uint64_t> m_framesPlayed{0};
+};
@@ -0,0 +1,143 @@
+#include "OpenAlSink.h"
+#include <algorithm>
+#include <stdexcept>
+
+static ALenum FormatFromChannels(int channels, bool float32) {
+    switch (channels) {
+    case 1:  return float32 ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_MONO16;
+    case 4:  return float32 ? AL_FORMAT_QUAD32 : AL_FORMAT_QUAD16;
+    case 6:  return float32 ? AL_FORMAT_51CHN32 : AL_FORMAT_51CHN16;
+    case 8:  return float32 ? AL_FORMAT_71CHN32 : AL_FORMAT_71CHN16;
+    default: return float32 ? AL_FORMAT_STEREO_FLOAT32 : AL_FORMAT_STEREO16;
+    }
+}
+
+void OpenAlSink::open(int maxBuffers, std::function<void()> wake) {
+    m_wake = std::move(wake);
+
+    m_device = alcOpenDevice(nullptr);
+    if (!m_device) {
+        throw std::runtime_error("OpenAL: Failed to open device");
+    }
+
+    m_context = alcCreateContext(m_device, nullptr);
+    if (!m_context || !alcMakeContextCurrent(m_context)) {
+        if (m_context) alcDestroyContext(m_context);
+        alcCloseDevice(m_device);
+        m_context = nullptr;
+        m_device = nullptr;
+        throw std::runtime_error("OpenAL: Failed to create or set context");
+    }
+
+    alGenSources(1, &m_source);
+    m_buffers.resize(maxBuffers);
+    alGenBuffers(maxBuffers, m_buffers.data());
+
+    m_floatOutput = alIsExtensionPresent("AL_EXT_FLOAT32") == AL_TRUE;
+    m_multichannel = alIsExtensionPresent("AL_EXT_MCFORMATS") == AL_TRUE;
+
+    if (alIsExtensionPresent("AL_SOFT_source_latency"))
+        m_getSourcei64v = reinterpret_cast<LPALGETSOURCEI64VSOFT>(
+            alGetProcAddress("alGetSourcei64vSOFT"));
+
+    // With AL_SOFT_events the mixer wakes the engine thread whenever a
+    // buffer completes or the source changes state.
+    if (alIsExtensionPresent("AL_SOFT_events")) {
+        auto eventControl = reinterpret_cast<LPALEVENTCONTROLSOFT>(
+            alGetProcAddress("alEventControlSOFT"));
+        m_alEventCallback = reinterpret_cast<LPALEVENTCALLBACKSOFT>(
+            alGetProcAddress("alEventCallbackSOFT"));
+        if (eventControl && m_alEventCallback) {
+            const ALenum types[] = {
+                AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT,
+                AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT
+            };
+            m_alEventCallback(&OpenAlSink::onAlEvent, this);
+            eventControl(2, types, AL_TRUE);
+            m_alEvents = true;
+        }
+    }
+}
+
+void OpenAlSink::close() {
+    if (!m_device) return;
+
+    clear();
+    if (m_alEvents) m_alEventCallback(nullptr, nullptr);
+    m_alEvents = false;
+
+    alDeleteSources(1, &m_source);
+    alDeleteBuffers(static_cast<ALsizei>(m_buffers.size()), m_buffers.data());
+    m_buffers.clear();
+
+    alcMakeContextCurrent(nullptr);
+    if (m_context) alcDestroyContext(m_context);
+    alcCloseDevice(m_device);
+    m_context = nullptr;
+    m_device = nullptr;
+}
+
+int OpenAlSink::maxChannels() const {
+    // Without AL_EXT_MCFORMATS surround tracks are downmixed to stereo.
+    return m_multichannel ? 8 : 2;
+}
+
+bool OpenAlSink::queue(int id, const void* samples, size_t frames, int channels, int sampleRate) {
+    ALuint buffer = m_buffers[id];
+    size_t sampleBytes = m_floatOutput ? sizeof(float) : sizeof(int16_t);
+    alBufferData(buffer, FormatFromChannels(channels, m_floatOutput), samples,
+                 static_cast<ALsizei>(frames * channels * sampleBytes), sampleRate);
+    if (alGetError() != AL_NO_ERROR) return false;
+
+    alSourceQueueBuffers(m_source, 1, &buffer);
+    return true;
+}
+
+int OpenAlSink::reclaim() {
+    ALint processed = 0;
+    alGetSourcei(m_source, AL_BUFFERS_PROCESSED, &processed);
+
+    ALuint ids[16];
+    int done = 0;
+    while (done < processed) {
+        ALsizei n = std::min<ALsizei>(processed - done, 16);
+        alSourceUnqueueBuffers(m_source, n, ids);
+        done += n;
+    }
+    return done;
+}
+
+void OpenAlSink::clear() {
+    alSourceStop(m_source);
+    alSourcei(m_source, AL_BUFFER, 0);
+}
+
+AudioSink::State OpenAlSink::state() {
+    ALint state = 0;
+    alGetSourcei(m_source, AL_SOURCE_STATE, &state);
+    if (state == AL_PLAYING) return State::Playing;
+    if (state == AL_PAUSED) return State::Paused;
+    return State::Stopped;
+}
+
+int64_t OpenAlSink::position(int64_t* latencyNs) {
+    int64_t offset = 0, latency = 0;
+    if (m_getSourcei64v) {
+        // 32.32 fixed-point offset and the device latency in nanoseconds.
+        ALint64SOFT values[2] = {0, 0};
+        m_getSourcei64v(m_source, AL_SAMPLE_OFFSET_LATENCY_SOFT, values);
+        offset = values[0] >> 32;
+        latency = values[1];
+    } else {
+        ALint value = 0;
+        alGetSourcei(m_source, AL_SAMPLE_OFFSET, &value);
+        offset = value;
+    }
+    if (latencyNs) *latencyNs = latency;
+    return offset;
+}
+
+void AL_APIENTRY OpenAlSink::onAlEvent(ALenum, ALuint, ALuint, ALsizei,
+                                       const ALchar*, void* userParam) noexcept {
+    static_cast<OpenAlSink*>(userParam)->m_wake();
+}
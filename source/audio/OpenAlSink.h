@@ -0,0 +1,53 @@
+#pragma once
+
+#include "AudioSink.h"
+#include <vector>
+
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <AL/alext.h>
+
+// The default output: one streaming source on the default device.
+class OpenAlSink : public AudioSink {
+public:
+    OpenAlSink() = default;
+    ~OpenAlSink() override { close(); }
+
+    OpenAlSink(const OpenAlSink&) = delete;
+    OpenAlSink& operator=(const OpenAlSink&) = delete;
+
+    void open(int maxBuffers, std::function<void()> wake) override;
+    void close() override;
+
+    bool floatOutput() const override { return m_floatOutput; }
+    int maxChannels() const override;
+    bool wakesOnProgress() const override { return m_alEvents; }
+    bool paced() const override { return true; }
+
+    bool queue(int id, const void* samples, size_t frames, int channels, int sampleRate) override;
+    int reclaim() override;
+    void clear() override;
+
+    void play() override { alSourcePlay(m_source); }
+    void pause() override { alSourcePause(m_source); }
+    void stop() override { alSourceStop(m_source); }
+    State state() override;
+    int64_t position(int64_t* latencyNs) override;
+
+private:
+    static void AL_APIENTRY onAlEvent(ALenum eventType, ALuint object, ALuint param,
+                                      ALsizei length, const ALchar* message,
+                                      void* userParam) noexcept;
+
+    ALCdevice*  m_device{nullptr};
+    ALCcontext* m_context{nullptr};
+    ALuint      m_source{0};
+    std::vector<ALuint> m_buffers;
+    std::function<void()> m_wake;
+
+    bool                  m_floatOutput{false};
+    bool                  m_multichannel{false};
+    bool                  m_alEvents{false};
+    LPALEVENTCALLBACKSOFT m_alEventCallback{nullptr};
+    LPALGETSOURCEI64VSOFT m_getSourcei64v{nullptr};
+};
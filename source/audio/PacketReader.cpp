@@ -0,0 +1,146 @@
+#include "PacketReader.h"
+#include <algorithm>
+
+PacketReader::~PacketReader() {
+    stop();
+    for (AVPacket* pkt : m_spare) av_packet_free(&pkt);
+}
+
+void PacketReader::start(AVFormatContext* fmt, int stream, Control* control) {
+    stop();
+
+    m_fmt = fmt;
+    m_stream = stream;
+    m_timeBase = av_q2d(fmt->streams[stream]->time_base);
+    m_control = control;
+    m_eof = false;
+    m_error = 0;
+    m_stop = false;
+    m_thread = std::thread(&PacketReader::run, this);
+}
+
+void PacketReader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+
+    // Packets are recycled rather than freed, so steady-state reading does
+    // not allocate packet structures.
+    while (m_count > 0) {
+        AVPacket* pkt = popFront();
+        av_packet_unref(pkt);
+        m_spare.push_back(pkt);
+    }
+    m_bytes = 0;
+    m_duration = 0;
+
+    // Stopped readers behave like an exhausted stream, but not a complete one.
+    m_eof = true;
+    if (m_error == 0) m_error = AVERROR_EXIT;
+    m_stop = false;
+}
+
+void PacketReader::push(AVPacket* pkt) {
+    if (m_count == m_queue.size()) {
+        // Unroll the ring into a larger buffer.
+        std::vector<AVPacket*> grown(std::max<size_t>(m_queue.size() * 2, 64));
+        for (size_t i = 0; i < m_count; ++i)
+            grown[i] = m_queue[(m_first + i) % m_queue.size()];
+        m_queue.swap(grown);
+        m_first = 0;
+        // Every shell is queued, spare or in the reader's hands, so the
+        // free list never needs more room than this.
+        m_spare.reserve(m_queue.size() + 1);
+    }
+    m_queue[(m_first + m_count) % m_queue.size()] = pkt;
+    ++m_count;
+}
+
+AVPacket* PacketReader::popFront() {
+    AVPacket* pkt = m_queue[m_first];
+    m_first = (m_first + 1) % m_queue.size();
+    --m_count;
+    return pkt;
+}
+
+bool PacketReader::full(const Control& control) const {
+    if (m_count == 0) return false;
+    if (m_bytes >= control.maxBytes.load(std::memory_order_relaxed)) return true;
+    return m_duration > 0 &&
+           m_duration * m_timeBase >= control.maxSeconds.load(std::memory_order_relaxed);
+}
+
+bool PacketReader::pop(AVPacket* out) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_count == 0 && !m_eof && !m_stop) {
+        if (m_control) m_control->decodeStalls.fetch_add(1, std::memory_order_relaxed);
+        m_cv.wait(lock, [this] { return m_count > 0 || m_eof || m_stop; });
+    }
+    if (m_count == 0) return false;
+
+    AVPacket* pkt = popFront();
+    m_bytes -= static_cast<size_t>(pkt->size);
+    m_duration -= pkt->duration;
+    av_packet_move_ref(out, pkt);
+    m_spare.push_back(pkt);
+    lock.unlock();
+
+    m_cv.notify_all();
+    return true;
+}
+
+int PacketReader::error() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+void PacketReader::run() {
+    Control fallback;
+    Control& control = m_control ? *m_control : fallback;
+
+    while (true) {
+        AVPacket* pkt = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (full(control) && !m_stop) {
+                control.readStalls.fetch_add(1, std::memory_order_relaxed);
+                m_cv.wait(lock, [&] { return !full(control) || m_stop; });
+            }
+            if (m_stop) return;
+
+            if (!m_spare.empty()) {
+                pkt = m_spare.back();
+                m_spare.pop_back();
+            }
+        }
+        if (!pkt) pkt = av_packet_alloc();
+
+        // Only this thread touches the format context while running.
+        int ret;
+        do {
+            ret = av_read_frame(m_fmt, pkt);
+            if (ret >= 0 && pkt->stream_index != m_stream) av_packet_unref(pkt);
+            else break;
+        } while (!m_stop);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ret < 0 || m_stop) {
+            av_packet_unref(pkt);
+            m_spare.push_back(pkt);
+            m_eof = true;
+            m_error = m_stop ? AVERROR_EXIT : ret;
+            m_cv.notify_all();
+            return;
+        }
+
+        control.packets.fetch_add(1, std::memory_order_relaxed);
+        control.bytes.fetch_add(static_cast<uint64_t>(pkt->size), std::memory_order_relaxed);
+        m_bytes += static_cast<size_t>(pkt->size);
+        m_duration += pkt->duration;
+        push(pkt);
+        m_cv.notify_all();
+    }
+}
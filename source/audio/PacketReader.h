@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// Demux stage of a decoder: a thread that reads packets of one stream
+// ahead into a bounded queue, so disk or network latency overlaps with
+// decoding instead of adding to it.
+class PacketReader {
+public:
+    // Queue limits and counters, shared by every reader of an engine.
+    // Limits may be changed at any time and apply on the next packet.
+    struct Control {
+        std::atomic<size_t>   maxBytes{4 << 20};
+        std::atomic<double>   maxSeconds{10.0};
+
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> readStalls{0};    // reader waited on a full queue
+        std::atomic<uint64_t> decodeStalls{0};  // decoder waited on an empty queue
+    };
+
+    PacketReader() = default;
+    ~PacketReader();
+
+    PacketReader(const PacketReader&) = delete;
+    PacketReader& operator=(const PacketReader&) = delete;
+
+    // Starts reading `stream` of `fmt` from its current position. The
+    // context must not be touched by anyone else until stop().
+    void start(AVFormatContext* fmt, int stream, Control* control);
+    // Joins the thread and drops queued packets.
+    void stop();
+    // True while stop() is interrupting the reader.
+    bool stopping() const { return m_stop.load(std::memory_order_relaxed); }
+
+    // Moves the next packet into `out`, waiting for the reader if needed.
+    // Returns false at the end of the stream, on error or once stopped.
+    bool pop(AVPacket* out);
+    // Why reading ended: AVERROR_EOF for a stream read to its end, another
+    // negative code on a read error or stop, 0 while still reading.
+    int error() const;
+
+private:
+    void run();
+    bool full(const Control& control) const;
+    void push(AVPacket* pkt);
+    AVPacket* popFront();
+
+    AVFormatContext* m_fmt{nullptr};
+    int              m_stream{-1};
+    double           m_timeBase{0.0};
+    Control*         m_control{nullptr};
+
+    std::thread             m_thread;
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_cv;
+    // Grow-only ring of queued packets and a free list of packet shells,
+    // so steady-state reading allocates nothing beyond packet payloads.
+    std::vector<AVPacket*>  m_queue;
+    size_t                  m_first{0};
+    size_t                  m_count{0};
+    std::vector<AVPacket*>  m_spare;
+    size_t                  m_bytes{0};
+    int64_t                 m_duration{0};
+    bool                    m_eof{true};
+    int                     m_error{AVERROR_EXIT};
+    std::atomic<bool>       m_stop{false};
+};
@@ -0,0 +1,88 @@
+#include "PcmCache.h"
+#include <filesystem>
+#include <system_error>
+
+SourceStamp SourceStamp::of(const std::string& path) {
+    SourceStamp stamp;
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::u8path(path);
+    auto size = std::filesystem::file_size(p, ec);
+    if (ec) return stamp;
+    auto mtime = std::filesystem::last_write_time(p, ec);
+    if (ec) return stamp;
+
+    stamp.size = static_cast<uint64_t>(size);
+    stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    stamp.valid = true;
+    return stamp;
+}
+
+std::string PcmCache::keyFor(const std::string& path, const SourceStamp& stamp) {
+    if (!stamp.valid) return {};
+    return path + '|' + std::to_string(stamp.size) + '|' + std::to_string(stamp.mtime);
+}
+
+void PcmCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    evictLocked();
+}
+
+size_t PcmCache::maxEntryBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget / 2;
+}
+
+std::shared_ptr<const PcmCache::Track> PcmCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = key.empty() ? m_index.end() : m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+
+    ++m_hits;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return it->second->track;
+}
+
+void PcmCache::insert(const std::string& key, std::shared_ptr<const Track> track) {
+    if (key.empty() || !track) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (track->bytes() > m_budget / 2) return;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_bytes -= it->second->track->bytes();
+        m_lru.erase(it->second);
+        m_index.erase(it);
+    }
+
+    m_bytes += track->bytes();
+    m_lru.push_front({key, std::move(track)});
+    m_index[key] = m_lru.begin();
+    evictLocked();
+}
+
+PcmCache::Stats PcmCache::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.budget = m_budget;
+    stats.bytes = m_bytes;
+    stats.entries = m_lru.size();
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    return stats;
+}
+
+void PcmCache::evictLocked() {
+    while (m_bytes > m_budget && !m_lru.empty()) {
+        Entry& victim = m_lru.back();
+        m_bytes -= victim.track->bytes();
+        m_index.erase(victim.key);
+        m_lru.pop_back();
+        ++m_evictions;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Identity of a source file's contents as far as caches are concerned.
+struct SourceStamp {
+    uint64_t size{0};
+    int64_t  mtime{0};
+    bool     valid{false};
+
+    static SourceStamp of(const std::string& path);
+    bool operator==(const SourceStamp& o) const {
+        return valid && o.valid && size == o.size && mtime == o.mtime;
+    }
+};
+
+// In-memory LRU of fully decoded tracks, bounded by a byte budget. Entries
+// are keyed by path, size and modification time, so an edited file is
+// never served stale. Entries are immutable and shared, so a reader keeps
+// its track alive even after it is evicted.
+class PcmCache {
+public:
+    struct Track {
+        int                sampleRate{0};
+        int                channels{0};
+        std::vector<float> samples;
+
+        size_t frames() const { return channels ? samples.size() / channels : 0; }
+        size_t bytes() const { return samples.size() * sizeof(float); }
+    };
+
+    struct Stats {
+        size_t   budget{0};
+        size_t   bytes{0};
+        size_t   entries{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+    };
+
+    // Empty when the file cannot be stat'ed.
+    static std::string keyFor(const std::string& path, const SourceStamp& stamp);
+
+    explicit PcmCache(size_t budget) : m_budget(budget) {}
+
+    PcmCache(const PcmCache&) = delete;
+    PcmCache& operator=(const PcmCache&) = delete;
+
+    void setBudget(size_t bytes);
+    // Largest track worth capturing; bigger ones would flush everything else.
+    size_t maxEntryBytes() const;
+
+    std::shared_ptr<const Track> find(const std::string& key);
+    void insert(const std::string& key, std::shared_ptr<const Track> track);
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string                  key;
+        std::shared_ptr<const Track> track;
+    };
+
+    void evictLocked();
+
+    mutable std::mutex m_mutex;
+    std::list<Entry>   m_lru;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t   m_budget{0};
+    size_t   m_bytes{0};
+    uint64_t m_hits{0};
+    uint64_t m_misses{0};
+    uint64_t m_evictions{0};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Lock-free playback clock. The engine publishes an anchor (frame, sample
+// rate, monotonic time) whenever it measures the source position; readers
+// on any thread extrapolate from the anchor with the monotonic clock, so
+// the position advances smoothly between measurements. Anchors are
+// published under a sequence lock, readers never block.
+class PlaybackClock {
+public:
+    struct Time {
+        int64_t frames{0};
+        int     sampleRate{0};
+        double  seconds{0.0};
+    };
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Anchors the clock at `frame`, measured at `timeNs`. While `running`,
+    // readers advance it at `sampleRate` times the playback speed.
+    void set(int64_t frame, int sampleRate, int64_t timeNs, bool running, double speed = 1.0) {
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        while ((seq & 1) || !m_seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire))
+            seq = m_seq.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_frame.store(frame, std::memory_order_relaxed);
+        m_rate.store(sampleRate, std::memory_order_relaxed);
+        m_timeNs.store(timeNs, std::memory_order_relaxed);
+        m_running.store(running, std::memory_order_relaxed);
+        m_speed.store(speed, std::memory_order_relaxed);
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Jumps to a position given in seconds and holds it there.
+    void reset(double seconds, int sampleRate) {
+        set(static_cast<int64_t>(seconds * sampleRate), sampleRate, nowNs(), false);
+    }
+
+    // Holds the clock at its current extrapolated position.
+    void freeze() {
+        int64_t now = nowNs();
+        Time t = at(now);
+        set(t.frames, t.sampleRate, now, false);
+    }
+
+    Time now() const { return at(nowNs()); }
+
+    Time at(int64_t timeNs) const {
+        int64_t frame, anchorNs;
+        int rate;
+        bool running;
+        double speed;
+        uint32_t seq;
+        do {
+            seq = m_seq.load(std::memory_order_acquire);
+            frame = m_frame.load(std::memory_order_relaxed);
+            rate = m_rate.load(std::memory_order_relaxed);
+            anchorNs = m_timeNs.load(std::memory_order_relaxed);
+            running = m_running.load(std::memory_order_relaxed);
+            speed = m_speed.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != m_seq.load(std::memory_order_relaxed));
+
+        // Never run far past the last measurement if the engine stalls.
+        if (running && rate > 0) {
+            int64_t elapsed = std::min(std::max<int64_t>(timeNs - anchorNs, 0), MAX_EXTRAPOLATE_NS);
+            frame += static_cast<int64_t>(elapsed * (rate * speed) / 1e9);
+        }
+
+        Time t;
+        t.frames = frame;
+        t.sampleRate = rate;
+        t.seconds = rate > 0 ? static_cast<double>(frame) / rate : 0.0;
+        return t;
+    }
+
+private:
+    static constexpr int64_t MAX_EXTRAPOLATE_NS = 500000000;
+
+    std::atomic<uint32_t> m_seq{0};
+    std::atomic<int64_t>  m_frame{0};
+    std::atomic<int>      m_rate{0};
+    std::atomic<int64_t>  m_timeNs{0};
+    std::atomic<bool>     m_running{false};
+    std::atomic<double>   m_speed{1.0};
+};
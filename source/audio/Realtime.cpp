@@ -0,0 +1,226 @@
+#include "Realtime.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+const char* ThreadPriorityName(ThreadPriorityLevel level) {
+    switch (level) {
+    case ThreadPriorityLevel::Raised:   return "raised";
+    case ThreadPriorityLevel::Realtime: return "real-time";
+    default:                            return "normal";
+    }
+}
+
+#ifdef _WIN32
+
+namespace {
+
+// avrt.dll is loaded at run time so the player still starts where the
+// multimedia class scheduler is missing.
+using AvSetMmThreadCharacteristicsFn = HANDLE (WINAPI*)(LPCWSTR, LPDWORD);
+using AvSetMmThreadPriorityFn = BOOL (WINAPI*)(HANDLE, int);
+using AvRevertMmThreadCharacteristicsFn = BOOL (WINAPI*)(HANDLE);
+
+struct Avrt {
+    AvSetMmThreadCharacteristicsFn    setCharacteristics{nullptr};
+    AvSetMmThreadPriorityFn           setPriority{nullptr};
+    AvRevertMmThreadCharacteristicsFn revert{nullptr};
+
+    Avrt() {
+        HMODULE module = LoadLibraryW(L"avrt.dll");
+        if (!module) return;
+        setCharacteristics = reinterpret_cast<AvSetMmThreadCharacteristicsFn>(
+            reinterpret_cast<void*>(GetProcAddress(module, "AvSetMmThreadCharacteristicsW")));
+        setPriority = reinterpret_cast<AvSetMmThreadPriorityFn>(
+            reinterpret_cast<void*>(GetProcAddress(module, "AvSetMmThreadPriority")));
+        revert = reinterpret_cast<AvRevertMmThreadCharacteristicsFn>(
+            reinterpret_cast<void*>(GetProcAddress(module, "AvRevertMmThreadCharacteristics")));
+    }
+};
+
+const Avrt& GetAvrt() {
+    static Avrt avrt;
+    return avrt;
+}
+
+constexpr int AVRT_PRIORITY_HIGH_VALUE = 1;
+
+} // namespace
+
+PriorityGrant RaiseCurrentThread(ThreadPriorityLevel wanted) {
+    PriorityGrant grant;
+    grant.oldPriority = GetThreadPriority(GetCurrentThread());
+    if (wanted == ThreadPriorityLevel::Normal) return grant;
+
+    if (wanted == ThreadPriorityLevel::Realtime) {
+        const Avrt& avrt = GetAvrt();
+        DWORD taskIndex = 0;
+        HANDLE task = avrt.setCharacteristics ? avrt.setCharacteristics(L"Pro Audio", &taskIndex) : nullptr;
+        if (task) {
+            if (avrt.setPriority) avrt.setPriority(task, AVRT_PRIORITY_HIGH_VALUE);
+            grant.mmcss = task;
+            grant.level = ThreadPriorityLevel::Realtime;
+            grant.method = "MMCSS Pro Audio";
+            return grant;
+        }
+    }
+
+    int priority = wanted == ThreadPriorityLevel::Realtime ? THREAD_PRIORITY_TIME_CRITICAL
+                                                           : THREAD_PRIORITY_HIGHEST;
+    if (SetThreadPriority(GetCurrentThread(), priority)) {
+        grant.level = ThreadPriorityLevel::Raised;
+        grant.method = priority == THREAD_PRIORITY_TIME_CRITICAL ? "THREAD_PRIORITY_TIME_CRITICAL"
+                                                                 : "THREAD_PRIORITY_HIGHEST";
+    }
+    return grant;
+}
+
+void RestoreCurrentThread(PriorityGrant& grant) {
+    if (grant.mmcss) {
+        const Avrt& avrt = GetAvrt();
+        if (avrt.revert) avrt.revert(grant.mmcss);
+        grant.mmcss = nullptr;
+    }
+    if (grant.level != ThreadPriorityLevel::Normal)
+        SetThreadPriority(GetCurrentThread(), grant.oldPriority);
+    grant.level = ThreadPriorityLevel::Normal;
+    grant.method.clear();
+}
+
+bool MemoryLock::add(const void* data, size_t bytes) {
+    if (!data || bytes == 0) return true;
+
+    // VirtualLock is bounded by the minimum working set; grow it first,
+    // and remember by how much so release() can give it back.
+    SIZE_T minSize = 0, maxSize = 0;
+    SIZE_T extra = bytes + 2 * 4096;
+    HANDLE process = GetCurrentProcess();
+    bool grown = false;
+    if (GetProcessWorkingSetSize(process, &minSize, &maxSize)) {
+        SIZE_T newMax = maxSize > minSize + extra ? maxSize : minSize + extra;
+        grown = SetProcessWorkingSetSize(process, minSize + extra, newMax) != 0;
+    }
+    if (!VirtualLock(const_cast<void*>(data), bytes)) {
+        if (grown && GetProcessWorkingSetSize(process, &minSize, &maxSize) && minSize >= extra)
+            SetProcessWorkingSetSize(process, minSize - extra, maxSize);
+        return false;
+    }
+
+    m_regions.push_back({data, bytes});
+    m_bytes += bytes;
+    if (grown) m_workingSet += extra;
+    return true;
+}
+
+void MemoryLock::release() {
+    for (const Region& region : m_regions)
+        VirtualUnlock(const_cast<void*>(region.data), region.bytes);
+    m_regions.clear();
+    m_bytes = 0;
+
+    SIZE_T minSize = 0, maxSize = 0;
+    HANDLE process = GetCurrentProcess();
+    if (m_workingSet > 0 && GetProcessWorkingSetSize(process, &minSize, &maxSize) &&
+        minSize >= m_workingSet)
+        SetProcessWorkingSetSize(process, minSize - m_workingSet, maxSize);
+    m_workingSet = 0;
+}
+
+#else
+
+namespace {
+
+bool SetNice(PriorityGrant& grant, int nice) {
+#ifdef __linux__
+    // On Linux the nice value is per thread, addressed by its tid.
+    id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+    errno = 0;
+    int old = getpriority(PRIO_PROCESS, tid);
+    if (errno != 0 || setpriority(PRIO_PROCESS, tid, nice) != 0) return false;
+    grant.oldNice = old;
+    grant.niced = true;
+    return true;
+#else
+    (void)grant;
+    (void)nice;
+    return false;
+#endif
+}
+
+} // namespace
+
+PriorityGrant RaiseCurrentThread(ThreadPriorityLevel wanted) {
+    PriorityGrant grant;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &grant.oldPolicy, &param);
+    grant.oldPriority = param.sched_priority;
+    if (wanted == ThreadPriorityLevel::Normal) return grant;
+
+    if (wanted == ThreadPriorityLevel::Realtime) {
+        // Modest priorities, within what rtkit and typical RLIMIT_RTPRIO
+        // settings allow.
+        for (int policy : {SCHED_FIFO, SCHED_RR}) {
+            sched_param rt{};
+            rt.sched_priority = std::min(sched_get_priority_min(policy) + 9,
+                                         sched_get_priority_max(policy));
+            if (pthread_setschedparam(pthread_self(), policy, &rt) == 0) {
+                grant.level = ThreadPriorityLevel::Realtime;
+                grant.method = std::string(policy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_RR ") +
+                               std::to_string(rt.sched_priority);
+                return grant;
+            }
+        }
+    }
+
+    int nice = wanted == ThreadPriorityLevel::Realtime ? -10 : -5;
+    if (SetNice(grant, nice)) {
+        grant.level = ThreadPriorityLevel::Raised;
+        grant.method = "nice " + std::to_string(nice);
+    }
+    return grant;
+}
+
+void RestoreCurrentThread(PriorityGrant& grant) {
+    if (grant.level == ThreadPriorityLevel::Realtime) {
+        sched_param param{};
+        param.sched_priority = grant.oldPriority;
+        pthread_setschedparam(pthread_self(), grant.oldPolicy, &param);
+    }
+#ifdef __linux__
+    if (grant.niced)
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), grant.oldNice);
+#endif
+    grant.niced = false;
+    grant.level = ThreadPriorityLevel::Normal;
+    grant.method.clear();
+}
+
+bool MemoryLock::add(const void* data, size_t bytes) {
+    if (!data || bytes == 0) return true;
+    if (mlock(data, bytes) != 0) return false;
+
+    m_regions.push_back({data, bytes});
+    m_bytes += bytes;
+    return true;
+}
+
+void MemoryLock::release() {
+    for (const Region& region : m_regions)
+        munlock(region.data, region.bytes);
+    m_regions.clear();
+    m_bytes = 0;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Scheduling and paging controls for the audio threads. Everything here
+// is best effort: each call falls back to the next weaker option when the
+// OS refuses, and reports what it actually got.
+
+enum class ThreadPriorityLevel {
+    Normal,
+    Raised,    // above normal, still time-shared
+    Realtime   // MMCSS "Pro Audio" or SCHED_FIFO/SCHED_RR
+};
+
+const char* ThreadPriorityName(ThreadPriorityLevel level);
+
+// What a thread was given and what it had before.
+struct PriorityGrant {
+    ThreadPriorityLevel level{ThreadPriorityLevel::Normal};
+    std::string         method;
+#ifdef _WIN32
+    void*               mmcss{nullptr};
+    int                 oldPriority{0};
+#else
+    int                 oldPolicy{0};
+    int                 oldPriority{0};
+    int                 oldNice{0};
+    bool                niced{false};
+#endif
+};
+
+// Raises the calling thread to at most `wanted`. Realtime tries MMCSS on
+// Windows and SCHED_FIFO then SCHED_RR elsewhere, then falls back to
+// Raised; Raised uses the thread priority or nice value.
+PriorityGrant RaiseCurrentThread(ThreadPriorityLevel wanted);
+// Undoes a grant on the thread that received it.
+void RestoreCurrentThread(PriorityGrant& grant);
+
+// Pins memory regions so touching them never page-faults. Regions must
+// stay allocated, and not move, until release().
+class MemoryLock {
+public:
+    MemoryLock() = default;
+    ~MemoryLock() { release(); }
+
+    MemoryLock(const MemoryLock&) = delete;
+    MemoryLock& operator=(const MemoryLock&) = delete;
+
+    bool add(const void* data, size_t bytes);
+    void release();
+    size_t bytes() const { return m_bytes; }
+
+private:
+    struct Region {
+        const void* data;
+        size_t      bytes;
+    };
+    std::vector<Region> m_regions;
+    size_t              m_bytes{0};
+#ifdef _WIN32
+    size_t              m_workingSet{0};  // added to the process minimum
+#endif
+};
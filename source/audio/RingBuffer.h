@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer ring of preallocated slots.
+// The producer fills writeSlot() in place and publishes it with
+// commitWrite(); the consumer reads readSlot() and releases it with
+// commitRead(). Neither side ever blocks or allocates.
+template <typename T>
+class RingBuffer {
+public:
+    struct Stats {
+        size_t   capacity{0};
+        size_t   fill{0};
+        size_t   highWater{0};
+        uint64_t written{0};
+        uint64_t read{0};
+        uint64_t fullWrites{0};
+        uint64_t emptyReads{0};
+    };
+
+    explicit RingBuffer(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        m_slots.resize(n);
+        m_mask = n - 1;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Producer side
+    T* writeSlot() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask) {
+            m_fullWrites.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &m_slots[head & m_mask];
+    }
+
+    void commitWrite() {
+        size_t head = m_head.load(std::memory_order_relaxed) + 1;
+        m_head.store(head, std::memory_order_release);
+
+        size_t fill = head - m_tail.load(std::memory_order_acquire);
+        if (fill > m_highWater.load(std::memory_order_relaxed))
+            m_highWater.store(fill, std::memory_order_relaxed);
+    }
+
+    // Consumer side
+    T* readSlot() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            m_emptyReads.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &m_slots[tail & m_mask];
+    }
+
+    void commitRead() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Slot storage, for preallocating element buffers before use.
+    std::vector<T>& slots() { return m_slots; }
+
+    size_t capacity() const { return m_slots.size(); }
+    size_t size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+    Stats stats() const {
+        Stats s;
+        s.capacity   = capacity();
+        s.written    = m_head.load(std::memory_order_acquire);
+        s.read       = m_tail.load(std::memory_order_acquire);
+        s.fill       = static_cast<size_t>(s.written - s.read);
+        s.highWater  = m_highWater.load(std::memory_order_relaxed);
+        s.fullWrites = m_fullWrites.load(std::memory_order_relaxed);
+        s.emptyReads = m_emptyReads.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::vector<T> m_slots;
+    size_t         m_mask{0};
+
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+
+    alignas(64) std::atomic<size_t>   m_highWater{0};
+    std::atomic<uint64_t> m_fullWrites{0};
+    std::atomic<uint64_t> m_emptyReads{0};
+};
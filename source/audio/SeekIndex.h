@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+// Packet timestamps and byte offsets of one stream, recorded as a side
+// effect of decoding it front to back. Entries are spaced at least
+// `spacing` apart (in stream time base), so the index stays small while a
+// seek lands at most that far before its target. Lookups only succeed
+// inside the contiguously decoded range.
+class SeekIndex {
+public:
+    struct Entry {
+        int64_t pts;
+        int64_t pos;
+    };
+
+    void reset(int64_t spacing) {
+        m_entries.clear();
+        m_spacing = std::max<int64_t>(spacing, 1);
+        m_coveredTo = std::numeric_limits<int64_t>::min();
+        m_complete = false;
+    }
+
+    // Room for `entries` entries, so building the index does not allocate.
+    void reserve(size_t entries) { m_entries.reserve(entries); }
+
+    // Called for every packet of a contiguous run, in decode order.
+    void add(int64_t pts, int64_t pos) {
+        if (m_complete || pos < 0) return;
+        if (m_entries.empty() || pts >= m_entries.back().pts + m_spacing)
+            m_entries.push_back({pts, pos});
+        m_coveredTo = std::max(m_coveredTo, pts);
+    }
+
+    // Replaces the index with a complete table loaded from elsewhere.
+    void restore(std::vector<Entry> entries) {
+        m_entries = std::move(entries);
+        m_coveredTo = m_entries.empty() ? std::numeric_limits<int64_t>::min() : m_entries.back().pts;
+        m_complete = !m_entries.empty();
+    }
+
+    // The run reached the end of the stream; every later timestamp is covered.
+    void markComplete() {
+        if (!m_entries.empty()) m_complete = true;
+    }
+
+    // Last entry at or before `pts`, or null when `pts` lies outside the
+    // indexed range.
+    const Entry* find(int64_t pts) const {
+        if (m_entries.empty() || pts < m_entries.front().pts) return nullptr;
+        if (!m_complete && pts > m_coveredTo) return nullptr;
+        auto it = std::upper_bound(m_entries.begin(), m_entries.end(), pts,
+                                   [](int64_t t, const Entry& e) { return t < e.pts; });
+        return &*std::prev(it);
+    }
+
+    bool complete() const { return m_complete; }
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+private:
+    std::vector<Entry> m_entries;
+    int64_t            m_spacing{1};
+    int64_t            m_coveredTo{std::numeric_limits<int64_t>::min()};
+    bool               m_complete{false};
+};
@@ -0,0 +1,376 @@
+#include "SeekTableStore.h"
+#include <filesystem>
+#include <system_error>
+#include <numeric>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/file.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char     MAGIC[4] = {'V', 'S', 'K', 'T'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t MAX_PATH_BYTES = 32 * 1024;
+constexpr uint32_t MAX_TABLE_BYTES = 16 << 20;
+constexpr uint64_t MIN_COMPACT_BYTES = 1 << 20;
+
+struct FileHeader {
+    char     magic[4];
+    uint32_t version;
+};
+
+struct RecordHeader {
+    uint32_t pathBytes;
+    uint32_t tableBytes;
+    uint64_t sourceSize;
+    int64_t  sourceMtime;
+};
+
+std::FILE* OpenFile(const fs::path& path, const char* mode) {
+#ifdef _WIN32
+    std::wstring wmode(mode, mode + std::strlen(mode));
+    return _wfopen(path.c_str(), wmode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+// fseek takes a long, which is 32 bits on Windows.
+bool SeekTo(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+void PutVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+uint64_t ZigZag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t UnZigZag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+// Count, tick, first entry, then per entry the change of the pts step (in
+// ticks) and of the offset step. Steps are nearly constant, so most of
+// these are a single byte.
+std::string EncodeTable(const std::vector<SeekIndex::Entry>& entries) {
+    int64_t tick = 0;
+    for (size_t i = 1; i < entries.size(); ++i)
+        tick = std::gcd(tick, entries[i].pts - entries[i - 1].pts);
+    if (tick <= 0) tick = 1;
+
+    std::string out;
+    PutVarint(out, entries.size());
+    if (entries.empty()) return out;
+    PutVarint(out, static_cast<uint64_t>(tick));
+    PutVarint(out, ZigZag(entries[0].pts));
+    PutVarint(out, static_cast<uint64_t>(entries[0].pos));
+
+    int64_t ptsStep = 0, posStep = 0;
+    for (size_t i = 1; i < entries.size(); ++i) {
+        int64_t dp = (entries[i].pts - entries[i - 1].pts) / tick;
+        int64_t dq = entries[i].pos - entries[i - 1].pos;
+        PutVarint(out, ZigZag(dp - ptsStep));
+        PutVarint(out, ZigZag(dq - posStep));
+        ptsStep = dp;
+        posStep = dq;
+    }
+    return out;
+}
+
+bool DecodeTable(const std::vector<uint8_t>& bytes, std::vector<SeekIndex::Entry>& entries) {
+    const uint8_t* p = bytes.data();
+    const uint8_t* end = p + bytes.size();
+    uint64_t count, tick, pts, pos;
+    if (!GetVarint(p, end, count) || count > bytes.size()) return false;
+    entries.clear();
+    if (count == 0) return true;
+    if (!GetVarint(p, end, tick) || !GetVarint(p, end, pts) || !GetVarint(p, end, pos))
+        return false;
+
+    entries.reserve(count);
+    entries.push_back({UnZigZag(pts), static_cast<int64_t>(pos)});
+    int64_t ptsStep = 0, posStep = 0;
+    for (uint64_t i = 1; i < count; ++i) {
+        uint64_t a, b;
+        if (!GetVarint(p, end, a) || !GetVarint(p, end, b)) return false;
+        ptsStep += UnZigZag(a);
+        posStep += UnZigZag(b);
+        const SeekIndex::Entry& prev = entries.back();
+        entries.push_back({prev.pts + ptsStep * static_cast<int64_t>(tick), prev.pos + posStep});
+        if (entries.back().pts <= prev.pts || entries.back().pos < 0) return false;
+    }
+    return p == end;
+}
+
+// Exclusive and held until the file is closed; fails at once if another
+// process holds it.
+bool LockExclusive(std::FILE* file) {
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    OVERLAPPED overlapped{};
+    return LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+                      0, 1, 0, &overlapped) != 0;
+#else
+    return flock(fileno(file), LOCK_EX | LOCK_NB) == 0;
+#endif
+}
+
+bool ReadAt(std::FILE* file, uint64_t offset, void* data, size_t bytes) {
+    return SeekTo(file, offset) &&
+           std::fread(data, 1, bytes, file) == bytes;
+}
+
+} // namespace
+
+SeekTableStore::SeekTableStore(std::string file) : m_path(std::move(file)) {}
+
+SeekTableStore::~SeekTableStore() {
+    if (m_file) std::fclose(m_file);
+    if (m_lockFile) std::fclose(m_lockFile);
+}
+
+bool SeekTableStore::openLocked() {
+    if (m_opened) return m_file != nullptr;
+    m_opened = true;
+    if (m_path.empty()) return false;
+
+    fs::path path = fs::u8path(m_path);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+
+    // Appends and compaction assume no other writer, so a second instance
+    // of the player runs without the store rather than share it.
+    m_lockFile = OpenFile(fs::u8path(m_path + ".lock"), "a+b");
+    if (!m_lockFile || !LockExclusive(m_lockFile)) {
+        std::cerr << "Seek table store in use by another process: " << m_path << std::endl;
+        if (m_lockFile) std::fclose(m_lockFile);
+        m_lockFile = nullptr;
+        return false;
+    }
+
+    FileHeader header{};
+    m_file = OpenFile(path, "r+b");
+    bool valid = m_file && ReadAt(m_file, 0, &header, sizeof(header)) &&
+                 std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION;
+    if (!valid) {
+        // Missing, foreign or outdated: start over.
+        if (m_file) std::fclose(m_file);
+        m_file = OpenFile(path, "w+b");
+        if (!m_file) {
+            std::cerr << "Failed to open seek table store: " << m_path << std::endl;
+            return false;
+        }
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        std::fwrite(&header, sizeof(header), 1, m_file);
+        std::fflush(m_file);
+        m_end = sizeof(header);
+        return true;
+    }
+
+    // Index the records. A torn record at the end (from a crash) ends the
+    // scan and is overwritten by the next append.
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) size = 0;
+    uint64_t offset = sizeof(header);
+    std::string recordPath;
+    while (true) {
+        RecordHeader rh;
+        if (!ReadAt(m_file, offset, &rh, sizeof(rh))) break;
+        if (rh.pathBytes == 0 || rh.pathBytes > MAX_PATH_BYTES || rh.tableBytes > MAX_TABLE_BYTES) break;
+        uint64_t tableOffset = offset + sizeof(rh) + rh.pathBytes;
+        uint64_t end = tableOffset + rh.tableBytes;
+        if (end > size) break;
+
+        recordPath.resize(rh.pathBytes);
+        if (std::fread(&recordPath[0], 1, rh.pathBytes, m_file) != rh.pathBytes) break;
+
+        Record& record = m_records[recordPath];
+        if (record.bytes > 0) m_deadBytes += sizeof(RecordHeader) + recordPath.size() + record.bytes;
+        record.stamp.size = rh.sourceSize;
+        record.stamp.mtime = rh.sourceMtime;
+        record.stamp.valid = true;
+        record.offset = tableOffset;
+        record.bytes = rh.tableBytes;
+        offset = end;
+    }
+    m_end = offset;
+    if (size > m_end) {
+        // Cut the torn tail with the file closed; Windows will not resize
+        // a file that is open.
+        std::fclose(m_file);
+        fs::resize_file(path, m_end, ec);
+        m_file = OpenFile(path, "r+b");
+        if (!m_file) {
+            std::cerr << "Failed to reopen seek table store: " << m_path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SeekTableStore::load(const std::string& path, const SourceStamp& stamp, SeekIndex& index) {
+    if (!stamp.valid) return false;
+
+    std::vector<uint8_t> bytes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!openLocked()) return false;
+        auto it = m_records.find(path);
+        if (it == m_records.end() || !(it->second.stamp == stamp)) {
+            ++m_misses;
+            return false;
+        }
+        bytes.resize(it->second.bytes);
+        if (!ReadAt(m_file, it->second.offset, bytes.data(), bytes.size())) {
+            ++m_misses;
+            return false;
+        }
+        ++m_hits;
+    }
+
+    std::vector<SeekIndex::Entry> entries;
+    if (!DecodeTable(bytes, entries) || entries.empty()) return false;
+    index.restore(std::move(entries));
+    return true;
+}
+
+void SeekTableStore::save(const std::string& path, const SourceStamp& stamp,
+                          const SeekIndex& index, int64_t spacing) {
+    if (!stamp.valid || !index.complete()) return;
+
+    std::vector<SeekIndex::Entry> thinned;
+    for (const SeekIndex::Entry& e : index.entries()) {
+        if (thinned.empty() || e.pts >= thinned.back().pts + spacing)
+            thinned.push_back(e);
+    }
+    std::string table = EncodeTable(thinned);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!openLocked()) return;
+    auto it = m_records.find(path);
+    if (it != m_records.end() && it->second.stamp == stamp) return;
+    if (appendLocked(path, stamp, table)) compactLocked();
+}
+
+bool SeekTableStore::appendLocked(const std::string& path, const SourceStamp& stamp,
+                                  const std::string& table) {
+    RecordHeader rh;
+    rh.pathBytes = static_cast<uint32_t>(path.size());
+    rh.tableBytes = static_cast<uint32_t>(table.size());
+    rh.sourceSize = stamp.size;
+    rh.sourceMtime = stamp.mtime;
+
+    bool ok = SeekTo(m_file, m_end) &&
+              std::fwrite(&rh, sizeof(rh), 1, m_file) == 1 &&
+              std::fwrite(path.data(), 1, path.size(), m_file) == path.size() &&
+              std::fwrite(table.data(), 1, table.size(), m_file) == table.size() &&
+              std::fflush(m_file) == 0;
+    if (!ok) return false;
+
+    Record& record = m_records[path];
+    if (record.bytes > 0) m_deadBytes += sizeof(RecordHeader) + path.size() + record.bytes;
+    record.stamp = stamp;
+    record.offset = m_end + sizeof(rh) + path.size();
+    record.bytes = rh.tableBytes;
+    m_end = record.offset + record.bytes;
+    ++m_writes;
+    return true;
+}
+
+void SeekTableStore::compactLocked() {
+    if (m_deadBytes < MIN_COMPACT_BYTES || m_deadBytes * 2 < m_end) return;
+
+    fs::path path = fs::u8path(m_path);
+    fs::path tmpPath = fs::u8path(m_path + ".tmp");
+    std::FILE* out = OpenFile(tmpPath, "wb");
+    if (!out) return;
+
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+
+    std::unordered_map<std::string, Record> records;
+    uint64_t end = sizeof(header);
+    std::vector<uint8_t> table;
+    for (auto it = m_records.begin(); ok && it != m_records.end(); ++it) {
+        const Record& record = it->second;
+        table.resize(record.bytes);
+        if (!ReadAt(m_file, record.offset, table.data(), table.size())) continue;
+
+        RecordHeader rh;
+        rh.pathBytes = static_cast<uint32_t>(it->first.size());
+        rh.tableBytes = record.bytes;
+        rh.sourceSize = record.stamp.size;
+        rh.sourceMtime = record.stamp.mtime;
+        ok = std::fwrite(&rh, sizeof(rh), 1, out) == 1 &&
+             std::fwrite(it->first.data(), 1, it->first.size(), out) == it->first.size() &&
+             std::fwrite(table.data(), 1, table.size(), out) == table.size();
+
+        Record moved = record;
+        moved.offset = end + sizeof(rh) + it->first.size();
+        end = moved.offset + moved.bytes;
+        records.emplace(it->first, moved);
+    }
+    ok = std::fclose(out) == 0 && ok;
+
+    std::error_code ec;
+    if (!ok) {
+        fs::remove(tmpPath, ec);
+        return;
+    }
+
+    // Swap files; on failure keep using the old one.
+    std::fclose(m_file);
+    m_file = nullptr;
+    fs::rename(tmpPath, path, ec);
+    if (ec) fs::remove(tmpPath, ec);
+    else {
+        m_records.swap(records);
+        m_end = end;
+        m_deadBytes = 0;
+    }
+    m_file = OpenFile(path, "r+b");
+}
+
+SeekTableStore::Stats SeekTableStore::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.tracks = m_records.size();
+    stats.fileBytes = m_end;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.writes = m_writes;
+    return stats;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include "PcmCache.h"
+#include "SeekIndex.h"
+
+// Complete seek indexes of played tracks, kept across runs in a single
+// append-only file. Tables are keyed by path and validated against the
+// source's size and mtime. Timestamps are stored as second differences
+// in units of the table's common tick and offsets as second differences,
+// both as varints, which comes to a few hundred bytes per track.
+//
+// The file is scanned on first use; only the record locations are kept
+// in memory and a table is read when its track is opened. Superseded
+// records are dropped by rewriting the file once they make up most of it.
+// A lock file next to it keeps other processes out while the store is open.
+class SeekTableStore {
+public:
+    struct Stats {
+        size_t   tracks{0};
+        uint64_t fileBytes{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t writes{0};
+    };
+
+    explicit SeekTableStore(std::string file);
+    ~SeekTableStore();
+
+    SeekTableStore(const SeekTableStore&) = delete;
+    SeekTableStore& operator=(const SeekTableStore&) = delete;
+
+    // Fills `index` with the stored table of `path` if it matches `stamp`.
+    bool load(const std::string& path, const SourceStamp& stamp, SeekIndex& index);
+    // Stores a complete index, keeping entries at least `spacing` apart.
+    void save(const std::string& path, const SourceStamp& stamp,
+              const SeekIndex& index, int64_t spacing);
+    Stats stats() const;
+
+private:
+    struct Record {
+        SourceStamp stamp;
+        uint64_t    offset{0};  // of the encoded table
+        uint32_t    bytes{0};
+    };
+
+    bool openLocked();
+    bool appendLocked(const std::string& path, const SourceStamp& stamp, const std::string& table);
+    void compactLocked();
+
+    mutable std::mutex m_mutex;
+    std::string        m_path;
+    std::FILE*         m_file{nullptr};
+    std::FILE*         m_lockFile{nullptr};
+    bool               m_opened{false};
+    uint64_t           m_end{0};
+    uint64_t           m_deadBytes{0};
+    std::unordered_map<std::string, Record> m_records;
+
+    uint64_t m_hits{0};
+    uint64_t m_misses{0};
+    uint64_t m_writes{0};
+};
@@ -0,0 +1,236 @@
+#include "TimeStretch.h"
+#include "AudioMix.h"
+#include "Realtime.h"
+#include <algorithm>
+#include <cmath>
+
+// Sums each run of `step` frames over all channels into one mono sample.
+static void MonoSum(const float* in, int channels, size_t outFrames, int step, float* out) {
+    const size_t run = static_cast<size_t>(step) * channels;
+    for (size_t j = 0; j < outFrames; ++j) {
+        const float* p = in + j * run;
+        float s = 0.0f;
+        for (size_t k = 0; k < run; ++k) s += p[k];
+        out[j] = s;
+    }
+}
+
+void TimeStretch::configure(int sampleRate, int channels, size_t maxBlockFrames) {
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+
+    // Correlate at about 16 kHz; window and tolerance are whole multiples
+    // of the decimation step.
+    m_decimate = std::max(1, sampleRate / 16000);
+    size_t step = static_cast<size_t>(m_decimate) * 2;
+    m_frame = std::max(step, static_cast<size_t>(sampleRate * 0.020) / step * step);
+    m_hop = m_frame / 2;
+    m_tolerance = static_cast<int64_t>(sampleRate * 0.006) / m_decimate * m_decimate;
+
+    // Periodic Hann: copies spaced half a window apart sum to one.
+    m_window.resize(m_frame);
+    m_firstWindow.resize(m_frame);
+    for (size_t i = 0; i < m_frame; ++i) {
+        m_window[i] = 0.5f - 0.5f * std::cos(2.0f * static_cast<float>(M_PI) * i / m_frame);
+        m_firstWindow[i] = i < m_hop ? 1.0f : m_window[i];
+    }
+
+    size_t span = m_frame + 2 * static_cast<size_t>(m_tolerance) +
+                  static_cast<size_t>(m_hop * MAX_SPEED) + 1;
+    m_in.reserve((maxBlockFrames + 2 * span) * channels);
+    m_acc.resize(m_frame * channels);
+    m_chunk.resize(m_frame * channels);
+    m_ref.resize(m_frame);
+    m_search.resize(span);
+    m_energy.resize(span + 1);
+    reset();
+}
+
+void TimeStretch::reset() {
+    m_in.clear();
+    m_inBase = 0;
+    m_inEnd = 0;
+    m_dataEnd = 0;
+    m_draining = false;
+    m_pos = 0.0;
+    m_prev = -1;
+    std::fill(m_acc.begin(), m_acc.end(), 0.0f);
+    m_chunkFrames = 0;
+    m_chunkRead = 0;
+    m_chunkSource = 0.0;
+    m_flushed = false;
+}
+
+bool TimeStretch::lockMemory(MemoryLock& lock) const {
+    bool locked = lock.add(m_in.data(), m_in.capacity() * sizeof(float));
+    locked &= lock.add(m_window.data(), m_window.capacity() * sizeof(float));
+    locked &= lock.add(m_firstWindow.data(), m_firstWindow.capacity() * sizeof(float));
+    locked &= lock.add(m_acc.data(), m_acc.capacity() * sizeof(float));
+    locked &= lock.add(m_chunk.data(), m_chunk.capacity() * sizeof(float));
+    locked &= lock.add(m_ref.data(), m_ref.capacity() * sizeof(float));
+    locked &= lock.add(m_search.data(), m_search.capacity() * sizeof(float));
+    locked &= lock.add(m_energy.data(), m_energy.capacity() * sizeof(double));
+    return locked;
+}
+
+void TimeStretch::setSpeed(double speed) {
+    m_speed = std::clamp(speed, MIN_SPEED, MAX_SPEED);
+}
+
+void TimeStretch::push(const float* in, size_t frames) {
+    // Drop input that no later frame can read from.
+    int64_t keep = static_cast<int64_t>(m_pos) - m_tolerance;
+    if (m_prev >= 0) keep = std::min(keep, m_prev + static_cast<int64_t>(m_hop));
+    keep = std::min(keep, m_inEnd);
+    if (keep > m_inBase) {
+        m_in.erase(m_in.begin(), m_in.begin() + (keep - m_inBase) * m_channels);
+        m_inBase = keep;
+    }
+
+    m_in.insert(m_in.end(), in, in + frames * m_channels);
+    m_inEnd += static_cast<int64_t>(frames);
+    m_dataEnd = m_inEnd;
+}
+
+void TimeStretch::drain() {
+    // Nothing to drain once everything pushed has been passed through.
+    if (m_draining || (m_prev < 0 && static_cast<int64_t>(m_pos) >= m_inEnd)) return;
+    m_draining = true;
+    // Enough silence for every frame that starts inside the data.
+    size_t pad = m_frame + static_cast<size_t>(m_tolerance) + 1;
+    m_in.resize(m_in.size() + pad * m_channels, 0.0f);
+    m_inEnd += static_cast<int64_t>(pad);
+}
+
+size_t TimeStretch::pull(float* out, size_t maxFrames, double* sourceFrame) {
+    size_t produced = 0;
+    while (produced < maxFrames) {
+        if (m_chunkRead == m_chunkFrames && !hop()) break;
+
+        if (produced == 0 && sourceFrame)
+            *sourceFrame = m_chunkSource + m_chunkRead * m_chunkSpeed;
+        size_t n = std::min(m_chunkFrames - m_chunkRead, maxFrames - produced);
+        std::copy_n(m_chunk.data() + m_chunkRead * m_channels, n * m_channels,
+                    out + produced * m_channels);
+        m_chunkRead += n;
+        produced += n;
+    }
+    return produced;
+}
+
+bool TimeStretch::hop() {
+    const size_t samples = m_hop * m_channels;
+
+    // Past the end of the data only the tail of the last frame is left.
+    if (m_draining && m_pos >= static_cast<double>(m_dataEnd)) {
+        if (m_flushed) return false;
+        m_flushed = true;
+        std::copy_n(m_acc.data(), samples, m_chunk.data());
+        m_chunkFrames = m_hop;
+        m_chunkRead = 0;
+        m_chunkSource = static_cast<double>(m_prev + static_cast<int64_t>(m_hop));
+        return true;
+    }
+
+    const int64_t frame = static_cast<int64_t>(m_frame);
+    const int64_t nominal = static_cast<int64_t>(m_pos);
+    const int64_t ref = m_prev >= 0 ? m_prev + static_cast<int64_t>(m_hop) : -1;
+    const bool unity = std::abs(m_speed - 1.0) < 1e-3;
+
+    int64_t start;
+    if (ref < 0) {
+        start = std::max(nominal, m_inBase);
+        if (start + frame > m_inEnd) return unity && passThrough(start);
+    } else if (unity) {
+        start = ref;
+        if (start + frame > m_inEnd) return passThrough(start);
+    } else {
+        if (std::max(nominal + m_tolerance, ref) + frame > m_inEnd) return false;
+        start = bestStart(nominal, ref);
+    }
+
+    OverlapAdd(frameAt(start), ref < 0 ? m_firstWindow.data() : m_window.data(),
+               m_acc.data(), m_frame, m_channels);
+
+    // The first half of the accumulator is complete.
+    std::copy_n(m_acc.data(), samples, m_chunk.data());
+    std::copy(m_acc.begin() + samples, m_acc.end(), m_acc.begin());
+    std::fill(m_acc.end() - samples, m_acc.end(), 0.0f);
+    m_chunkFrames = m_hop;
+    m_chunkRead = 0;
+    m_chunkSource = static_cast<double>(start);
+    m_chunkSpeed = m_speed;
+
+    m_prev = start;
+    m_pos = unity ? static_cast<double>(start + frame / 2) : m_pos + m_hop * m_speed;
+    return true;
+}
+
+bool TimeStretch::passThrough(int64_t from) {
+    // At speed 1 the output is the input, and the next frame's rising half
+    // would complete the accumulator to exactly the input frames. So what
+    // is held from `from` on goes out unchanged, and the next push starts
+    // afresh with a flat first window.
+    if (m_draining || from >= m_inEnd) return false;
+
+    const size_t frames = static_cast<size_t>(m_inEnd - from);
+    std::copy_n(frameAt(from), frames * m_channels, m_chunk.data());
+    std::fill(m_acc.begin(), m_acc.end(), 0.0f);
+    m_chunkFrames = frames;
+    m_chunkRead = 0;
+    m_chunkSource = static_cast<double>(from);
+    m_chunkSpeed = 1.0;
+
+    m_prev = -1;
+    m_pos = static_cast<double>(m_inEnd);
+    return true;
+}
+
+int64_t TimeStretch::bestStart(int64_t nominal, int64_t ref) {
+    const int64_t step = m_decimate;
+    const int64_t lo = std::max(nominal - m_tolerance, m_inBase);
+    const int64_t hi = nominal + m_tolerance;
+    const size_t span = static_cast<size_t>(hi - lo) + m_frame;
+
+    // Coarse search over every step-th shift, on the decimated signal.
+    size_t len = m_frame / step;
+    size_t searchLen = span / step;
+    MonoSum(frameAt(ref), m_channels, len, m_decimate, m_ref.data());
+    MonoSum(frameAt(lo), m_channels, searchLen, m_decimate, m_search.data());
+    m_energy[0] = 0.0;
+    for (size_t j = 0; j < searchLen; ++j)
+        m_energy[j + 1] = m_energy[j] + static_cast<double>(m_search[j]) * m_search[j];
+
+    size_t candidates = static_cast<size_t>(hi - lo) / step + 1;
+    candidates = std::min(candidates, searchLen - len + 1);
+    double bestScore = -1e300;
+    int64_t coarse = lo;
+    for (size_t j = 0; j < candidates; ++j) {
+        double energy = m_energy[j + len] - m_energy[j];
+        double score = DotProduct(m_ref.data(), m_search.data() + j, len) / std::sqrt(energy + 1e-9);
+        if (score > bestScore) {
+            bestScore = score;
+            coarse = lo + static_cast<int64_t>(j) * step;
+        }
+    }
+    if (step == 1) return coarse;
+
+    // Refine around the coarse pick at full rate.
+    int64_t rlo = std::max(lo, coarse - step + 1);
+    int64_t rhi = std::min(hi, coarse + step - 1);
+    MonoSum(frameAt(ref), m_channels, m_frame, 1, m_ref.data());
+    MonoSum(frameAt(rlo), m_channels, static_cast<size_t>(rhi - rlo) + m_frame, 1, m_search.data());
+
+    int64_t best = coarse;
+    bestScore = -1e300;
+    for (int64_t s = rlo; s <= rhi; ++s) {
+        const float* cand = m_search.data() + (s - rlo);
+        double energy = DotProduct(cand, cand, m_frame);
+        double score = DotProduct(m_ref.data(), cand, m_frame) / std::sqrt(energy + 1e-9);
+        if (score > bestScore) {
+            bestScore = score;
+            best = s;
+        }
+    }
+    return best;
+}
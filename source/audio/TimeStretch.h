@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class MemoryLock;
+
+// Tempo change without pitch change, by WSOLA (waveform-similarity
+// overlap-add). Input is cut into Hann-windowed frames of 20 ms that are
+// laid down at a fixed output hop of half a frame, while the read
+// position advances by `speed` times that hop. Each frame is shifted by
+// up to 6 ms to where it best continues the previous one, found by a
+// normalized cross-correlation on a decimated mono signal and refined at
+// full rate. At speed 1 frames are taken back to back, which reproduces
+// the input exactly; once no whole frame is left the held input is passed
+// through as it is, so the stretcher empties and can be bypassed.
+//
+// Positions are counted in input frames since the last reset.
+class TimeStretch {
+public:
+    static constexpr double MIN_SPEED = 0.5;
+    static constexpr double MAX_SPEED = 3.0;
+
+    // Sizes every buffer for pushes of up to `maxBlockFrames` and resets.
+    void configure(int sampleRate, int channels, size_t maxBlockFrames);
+    void reset();
+
+    // Pins every buffer. They only move when configure() needs more room.
+    bool lockMemory(MemoryLock& lock) const;
+
+    // Applies from the next output hop.
+    void setSpeed(double speed);
+    double speed() const { return m_speed; }
+    int sampleRate() const { return m_sampleRate; }
+    int channels() const { return m_channels; }
+
+    // True while input or output is held. Goes false at speed 1 once
+    // everything pushed has been pulled back out.
+    bool active() const {
+        return m_chunkRead < m_chunkFrames || m_prev >= 0 ||
+               static_cast<int64_t>(m_pos) < m_inEnd;
+    }
+
+    void push(const float* in, size_t frames);
+    // Writes up to `maxFrames` frames; `sourceFrame` receives the input
+    // position of the first one.
+    size_t pull(float* out, size_t maxFrames, double* sourceFrame);
+    // Marks the end of the input, so the frames still held come out.
+    void drain();
+
+private:
+    bool hop();
+    bool passThrough(int64_t from);
+    int64_t bestStart(int64_t nominal, int64_t ref);
+    const float* frameAt(int64_t frame) const {
+        return m_in.data() + (frame - m_inBase) * m_channels;
+    }
+
+    int    m_sampleRate{0};
+    int    m_channels{0};
+    double m_speed{1.0};
+
+    size_t m_frame{0};       // window length
+    size_t m_hop{0};         // output hop, half a window
+    int64_t m_tolerance{0};  // search range either side of the nominal position
+    int    m_decimate{1};
+
+    std::vector<float> m_window;
+    std::vector<float> m_firstWindow;  // flat start, so output begins at full level
+
+    // Input frames [m_inBase, m_inEnd); m_dataEnd excludes drain padding.
+    std::vector<float> m_in;
+    int64_t m_inBase{0};
+    int64_t m_inEnd{0};
+    int64_t m_dataEnd{0};
+    bool    m_draining{false};
+
+    double  m_pos{0.0};  // nominal read position of the next frame
+    int64_t m_prev{-1};  // where the previous frame was read from
+
+    std::vector<float> m_acc;
+    std::vector<float> m_chunk;  // a hop, or up to a frame when passing through
+    size_t m_chunkFrames{0};
+    size_t m_chunkRead{0};
+    double m_chunkSource{0.0};
+    double m_chunkSpeed{1.0};
+    bool   m_flushed{false};
+
+    std::vector<float>  m_ref;
+    std::vector<float>  m_search;
+    std::vector<double> m_energy;
+};
@@ -0,0 +1,193 @@
+#include "TrackPrefetch.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+constexpr size_t CHUNK_BYTES = 1 << 20;
+
+} // namespace
+
+TrackPrefetch::TrackPrefetch(size_t budget) : m_budget(budget) {
+    m_thread = std::thread(&TrackPrefetch::run, this);
+}
+
+TrackPrefetch::~TrackPrefetch() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void TrackPrefetch::setBudget(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = bytes;
+        ++m_generation;
+        trimLocked();
+    }
+    m_cv.notify_all();
+}
+
+void TrackPrefetch::setUpcoming(std::vector<std::string> files) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (files == m_upcoming) return;
+        m_upcoming = std::move(files);
+        ++m_generation;
+        trimLocked();
+    }
+    m_cv.notify_all();
+}
+
+std::shared_ptr<const TrackPrefetch::Image> TrackPrefetch::find(const std::string& path) {
+    SourceStamp stamp = SourceStamp::of(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& image : m_images) {
+        if (image->path == path && image->stamp == stamp) {
+            ++m_hits;
+            return image;
+        }
+    }
+    ++m_misses;
+    return nullptr;
+}
+
+TrackPrefetch::Stats TrackPrefetch::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.budget = m_budget;
+    stats.bytes = m_bytes;
+    stats.entries = m_images.size();
+    for (const Evicted& e : m_evicted) {
+        if (e.image.expired()) stats.bytes -= e.bytes;
+        else ++stats.evicted;
+    }
+    stats.loads = m_loads;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.skipped = m_skipped;
+    return stats;
+}
+
+bool TrackPrefetch::wantedLocked(const std::string& path, uint64_t generation) const {
+    if (m_stop) return false;
+    if (generation == m_generation) return true;
+    return std::find(m_upcoming.begin(), m_upcoming.end(), path) != m_upcoming.end();
+}
+
+void TrackPrefetch::trimLocked() {
+    auto rank = [this](const std::shared_ptr<const Image>& image) {
+        return static_cast<size_t>(std::find(m_upcoming.begin(), m_upcoming.end(), image->path) -
+                                   m_upcoming.begin());
+    };
+    std::stable_sort(m_images.begin(), m_images.end(),
+                     [&](const auto& a, const auto& b) { return rank(a) < rank(b); });
+
+    // Unlisted files first, then the least urgent ones over budget. An
+    // image a decoder still reads stays counted until it lets go.
+    sweepLocked();
+    while (!m_images.empty() &&
+           (rank(m_images.back()) == m_upcoming.size() || m_bytes > m_budget)) {
+        m_evicted.push_back({m_images.back(), m_images.back()->bytes.size()});
+        m_images.pop_back();
+    }
+    sweepLocked();
+}
+
+void TrackPrefetch::sweepLocked() {
+    auto released = [this](const Evicted& e) {
+        if (!e.image.expired()) return false;
+        m_bytes -= e.bytes;
+        return true;
+    };
+    m_evicted.erase(std::remove_if(m_evicted.begin(), m_evicted.end(), released),
+                    m_evicted.end());
+}
+
+void TrackPrefetch::run() {
+    std::vector<std::string> attempted;
+    uint64_t attemptedGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        if (attemptedGeneration != m_generation) {
+            attempted.clear();
+            attemptedGeneration = m_generation;
+        }
+
+        // The most urgent file that is neither loaded nor already tried.
+        const std::string* next = nullptr;
+        for (const std::string& path : m_upcoming) {
+            bool loaded = std::any_of(m_images.begin(), m_images.end(),
+                                      [&](const auto& image) { return image->path == path; });
+            if (!loaded && std::find(attempted.begin(), attempted.end(), path) == attempted.end()) {
+                next = &path;
+                break;
+            }
+        }
+        if (!next) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        std::string path = *next;
+        attempted.push_back(path);
+        uint64_t generation = m_generation;
+        lock.unlock();
+        std::shared_ptr<Image> image = load(path, generation);
+        lock.lock();
+
+        if (!image || !wantedLocked(path, generation)) continue;
+        sweepLocked();
+        if (m_bytes + image->bytes.size() > m_budget) {
+            ++m_skipped;
+            continue;
+        }
+        m_bytes += image->bytes.size();
+        m_images.push_back(std::move(image));
+        ++m_loads;
+    }
+}
+
+std::shared_ptr<TrackPrefetch::Image> TrackPrefetch::load(const std::string& path, uint64_t generation) {
+    SourceStamp stamp = SourceStamp::of(path);
+    if (!stamp.valid) return nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sweepLocked();
+        if (m_bytes + stamp.size > m_budget) {
+            ++m_skipped;
+            return nullptr;
+        }
+    }
+
+    std::ifstream in(std::filesystem::u8path(path), std::ios::binary);
+    if (!in) return nullptr;
+
+    auto image = std::make_shared<Image>();
+    image->path = path;
+    image->stamp = stamp;
+    image->bytes.resize(static_cast<size_t>(stamp.size));
+
+    // Read in chunks so a changed queue or shutdown abandons the file early.
+    size_t done = 0;
+    while (done < image->bytes.size()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!wantedLocked(path, generation)) return nullptr;
+        }
+        size_t n = std::min(CHUNK_BYTES, image->bytes.size() - done);
+        in.read(reinterpret_cast<char*>(image->bytes.data() + done), static_cast<std::streamsize>(n));
+        if (static_cast<size_t>(in.gcount()) != n) return nullptr;
+        done += n;
+    }
+
+    // A file rewritten while it was read is not worth keeping.
+    if (!(SourceStamp::of(path) == stamp)) return nullptr;
+    return image;
+}
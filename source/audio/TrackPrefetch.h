@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include "PcmCache.h"
+
+// Background loader for the compressed files of upcoming queue entries.
+// A decoder opening a prefetched track demuxes it from memory, so a track
+// change on a slow or network drive needs no I/O at all. Files are held
+// in their container format, which costs about as much as the packets
+// themselves and keeps seeking and probing working unchanged.
+class TrackPrefetch {
+public:
+    struct Image {
+        std::string          path;
+        SourceStamp          stamp;
+        std::vector<uint8_t> bytes;
+    };
+
+    struct Stats {
+        size_t   budget{0};
+        size_t   bytes{0};    // including dropped images still in use
+        size_t   entries{0};
+        size_t   evicted{0};  // dropped images a decoder still holds
+        uint64_t loads{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t skipped{0};  // upcoming files that did not fit the budget
+    };
+
+    explicit TrackPrefetch(size_t budget);
+    ~TrackPrefetch();
+
+    TrackPrefetch(const TrackPrefetch&) = delete;
+    TrackPrefetch& operator=(const TrackPrefetch&) = delete;
+
+    void setBudget(size_t bytes);
+    // Files to hold, most urgent first. Entries no longer listed are
+    // dropped; later files are skipped once the budget is used up.
+    void setUpcoming(std::vector<std::string> files);
+
+    // The prefetched file, if it is loaded and unchanged on disk. The
+    // image stays valid for as long as the caller holds it, and counts
+    // against the budget until then even once dropped from the list.
+    std::shared_ptr<const Image> find(const std::string& path);
+    Stats stats() const;
+
+private:
+    void run();
+    bool wantedLocked(const std::string& path, uint64_t generation) const;
+    void trimLocked();
+    void sweepLocked();
+    std::shared_ptr<Image> load(const std::string& path, uint64_t generation);
+
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_cv;
+    std::thread             m_thread;
+    bool                    m_stop{false};
+
+    std::vector<std::string>                  m_upcoming;
+    uint64_t                                  m_generation{0};
+    std::vector<std::shared_ptr<const Image>> m_images;
+    struct Evicted {
+        std::weak_ptr<const Image> image;
+        size_t                     bytes{0};
+    };
+    std::vector<Evicted>                      m_evicted;
+    size_t   m_budget{0};
+    size_t   m_bytes{0};
+    uint64_t m_loads{0};
+    uint64_t m_hits{0};
+    uint64_t m_misses{0};
+    uint64_t m_skipped{0};
+};
@@ -18,24 +18,48 @@ std::atomic<bool> lyricsLoading(false);
 std::atomic<GLuint> activeAlbumArtTexture{0};
 std::atomic<bool> albumArtLoading{false};
 
+// Bumped on every track change; art and lyrics work for an older
+// generation is abandoned instead of running to completion.
+std::atomic<uint32_t> loadGeneration{0};
+
 struct AlbumArtData {
     std::vector<unsigned char> data;
 };
 std::optional<AlbumArtData> pendingAlbumArt;
+std::mutex pendingAlbumArtMutex;
+
+// Lyrics are handed to the GUI thread the same way as album art.
+std::optional<std::string> pendingLyrics;
+std::mutex pendingLyricsMutex;
+// Whether the active track's lyrics have been asked for; a track without
+// cached metadata is asked for once the engine has opened it.
+bool lyricsRequested = false;
+
+static int AlbumArtInterrupt(void* opaque) {
+    uint32_t generation = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(opaque));
+    return generation != loadGeneration.load() ? 1 : 0;
+}
 
 void LoadAlbumArtAsync(const std::string& filePath) {
     albumArtLoading = true;
-    pendingAlbumArt.reset();
+    {
+        std::lock_guard<std::mutex> lock(pendingAlbumArtMutex);
+        pendingAlbumArt.reset();
+    }
+
+    uint32_t generation = loadGeneration.load();
+    std::thread([filePath, generation]() {
+        AVFormatContext* fmt_ctx = avformat_alloc_context();
+        fmt_ctx->interrupt_callback.callback = AlbumArtInterrupt;
+        fmt_ctx->interrupt_callback.opaque = reinterpret_cast<void*>(static_cast<uintptr_t>(generation));
 
-    std::thread([filePath]() {
-        AVFormatContext* fmt_ctx = nullptr;
         if (avformat_open_input(&fmt_ctx, filePath.c_str(), nullptr, nullptr) < 0) {
-            albumArtLoading = false;
+            if (generation == loadGeneration) albumArtLoading = false;
             return;
         }
         if (avformat_find_stream_info(fmt_ctx, nullptr) < 0) {
             avformat_close_input(&fmt_ctx);
-            albumArtLoading = false;
+            if (generation == loadGeneration) albumArtLoading = false;
             return;
         }
 
@@ -44,18 +68,90 @@ void LoadAlbumArtAsync(const std::string& filePath) {
             if (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) {
                 AVPacket* pkt = &stream->attached_pic;
                 if (pkt->data && pkt->size > 0) {
-                    pendingAlbumArt = AlbumArtData{
-                        std::vector<unsigned char>(pkt->data, pkt->data + pkt->size)
-                    };
+                    std::lock_guard<std::mutex> lock(pendingAlbumArtMutex);
+                    if (generation == loadGeneration) {
+                        pendingAlbumArt = AlbumArtData{
+                            std::vector<unsigned char>(pkt->data, pkt->data + pkt->size)
+                        };
+                    }
                     break;
                 }
             }
         }
         avformat_close_input(&fmt_ctx);
-        albumArtLoading = false;
+        if (generation == loadGeneration) albumArtLoading = false;
+    }).detach();
+}
+
+void FetchLyricsAsync(const std::string& title, const std::string& artist) {
+    lyricsLoading = true;
+    activeFileLyrics.clear();
+    {
+        std::lock_guard<std::mutex> lock(pendingLyricsMutex);
+        pendingLyrics.reset();
+    }
+
+    uint32_t generation = loadGeneration.load();
+    std::thread([title, artist, generation]() {
+        auto cancelled = [generation]() { return generation != loadGeneration.load(); };
+        std::string lyrics = FetchLyrics(title, artist, cancelled);
+
+        // Checked under the lock, so a newer load that has cleared the
+        // pending result cannot be overwritten by this one.
+        std::lock_guard<std::mutex> lock(pendingLyricsMutex);
+        if (cancelled()) return;
+        pendingLyrics = lyrics.empty() ? "No lyrics found" : std::move(lyrics);
     }).detach();
 }
 
+void QueueNextTrack() {
+    const auto& audioFiles = audioManager.GetAudioFiles();
+    auto it = std::find(audioFiles.begin(), audioFiles.end(), activeFilePath);
+    if (g_audio.shuffle() && audioFiles.size() > 1) {
+        static std::mt19937 rng{std::random_device{}()};
+        size_t current = it != audioFiles.end() ? static_cast<size_t>(it - audioFiles.begin()) : audioFiles.size();
+        size_t pick = std::uniform_int_distribution<size_t>(0, audioFiles.size() - 2)(rng);
+        if (pick >= current) ++pick;
+        g_audio.setNextTrack(audioFiles[pick]);
+        g_audio.setUpcoming({audioFiles[pick]});
+    } else if (it != audioFiles.end() && std::next(it) != audioFiles.end()) {
+        g_audio.setNextTrack(*std::next(it));
+        // Pull the next few files into memory ahead of time.
+        constexpr ptrdiff_t PREFETCH_TRACKS = 3;
+        auto first = std::next(it);
+        auto last = std::next(first, std::min(PREFETCH_TRACKS, std::distance(first, audioFiles.end())));
+        g_audio.setUpcoming(std::vector<std::string>(first, last));
+    } else {
+        g_audio.setNextTrack("");
+        g_audio.setUpcoming({});
+    }
+}
+
+void RequestLyrics(const std::optional<AudioMetadata>& metadata) {
+    if (lyricsRequested || !metadata) return;
+    lyricsRequested = true;
+    FetchLyricsAsync(metadata->title, metadata->artist);
+}
+
+void OnTrackChanged() {
+    ++loadGeneration;
+
+    // The old track's lyrics go now, whether or not the new one's can be
+    // fetched yet.
+    activeFileLyrics.clear();
+    lyricsLoading = false;
+    lyricsRequested = false;
+    {
+        std::lock_guard<std::mutex> lock(pendingLyricsMutex);
+        pendingLyrics.reset();
+    }
+    const auto& cache = audioManager.GetMetadataCache();
+    auto it = cache.find(activeFilePath);
+    if (it != cache.end()) RequestLyrics(it->second);
+    LoadAlbumArtAsync(activeFilePath);
+    QueueNextTrack();
+}
+
 void GuiLoop(GLFWwindow* window) {
     static bool cbSet = false;
     if (!cbSet) {
@@ -72,14 +168,37 @@ void GuiLoop(GLFWwindow* window) {
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
 
-        if (pendingAlbumArt.has_value()) {
-            GLuint old = activeAlbumArtTexture.load();
-            if (old) glDeleteTextures(1, &old);
-            GLuint tex = !pendingAlbumArt->data.empty()
-                ? LoadTextureFromMemory(pendingAlbumArt->data.data(), pendingAlbumArt->data.size())
-                : 0;
-            activeAlbumArtTexture.store(tex);
-            pendingAlbumArt.reset();
+        {
+            std::lock_guard<std::mutex> lock(pendingAlbumArtMutex);
+            if (pendingAlbumArt.has_value()) {
+                GLuint old = activeAlbumArtTexture.load();
+                if (old) glDeleteTextures(1, &old);
+                GLuint tex = !pendingAlbumArt->data.empty()
+                    ? LoadTextureFromMemory(pendingAlbumArt->data.data(), pendingAlbumArt->data.size())
+                    : 0;
+                activeAlbumArtTexture.store(tex);
+                pendingAlbumArt.reset();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(pendingLyricsMutex);
+            if (pendingLyrics.has_value()) {
+                activeFileLyrics = std::move(*pendingLyrics);
+                pendingLyrics.reset();
+                lyricsLoading = false;
+            }
+        }
+
+        // The engine advances on its own at gapless track boundaries.
+        AudioEvent event;
+        while (g_audio.pollEvent(event)) {
+            if (event.type != AudioEventType::TrackStarted) continue;
+            if (event.file != activeFilePath) {
+                activeFilePath = event.file;
+                OnTrackChanged();
+            }
+            if (!lyricsRequested && g_audio.currentFile() == activeFilePath)
+                RequestLyrics(g_audio.currentMetadata());
         }
 
         ImGui::NewFrame();
@@ -151,16 +270,7 @@ void GuiLoop(GLFWwindow* window) {
             if (ImGui::Selectable("##sel", isPlaying, 0, ImVec2(0, 38))) {
                 activeFilePath = path;
                 g_audio.loadAndPlay(path);  
-                
-                lyricsLoading = true;
-                activeFileLyrics.clear();
-                std::thread([title = meta.title, artist = meta.artist]() {
-                    activeFileLyrics = FetchLyrics(title, artist);
-                    if (activeFileLyrics.empty()) activeFileLyrics = "No lyrics found";
-                    lyricsLoading = false;
-                }).detach();
-
-                LoadAlbumArtAsync(path);
+                OnTrackChanged();
             }
 
             ImGui::SetCursorPosY(ImGui::GetCursorPosY() - 38 + 10);
@@ -326,7 +436,7 @@ void GuiLoop(GLFWwindow* window) {
                 --it;
                 activeFilePath = *it;
                 g_audio.loadAndPlay(activeFilePath);
-                LoadAlbumArtAsync(activeFilePath);
+                OnTrackChanged();
             }
         }
 
@@ -344,20 +454,23 @@ void GuiLoop(GLFWwindow* window) {
                 if (next != audioFiles.end()) {
                     activeFilePath = *next;
                     g_audio.loadAndPlay(activeFilePath);
-                    LoadAlbumArtAsync(activeFilePath);
+                    OnTrackChanged();
                 }
             }
         }
         
-        static bool repeat = false, shuffle = false;
+        bool repeat = g_audio.repeat(), shuffle = g_audio.shuffle();
         ImGui::SetCursorPos(ImVec2(510, 25));
         ImGui::PushStyleColor(ImGuiCol_Button, repeat ? ImVec4(0.1f,0.3f,0.7f,1) : ImVec4(0.2f,0.2f,0.2f,1));
-        if (ImGui::Button(u8"\uf01e", ImVec2(30,30))) repeat = !repeat;
+        if (ImGui::Button(u8"\uf01e", ImVec2(30,30))) g_audio.setRepeat(!repeat);
         ImGui::PopStyleColor();
 
         ImGui::SetCursorPos(ImVec2(785, 25));
         ImGui::PushStyleColor(ImGuiCol_Button, shuffle ? ImVec4(0.1f,0.3f,0.7f,1) : ImVec4(0.2f,0.2f,0.2f,1));
-        if (ImGui::Button(u8"\uf074", ImVec2(30,30))) shuffle = !shuffle;
+        if (ImGui::Button(u8"\uf074", ImVec2(30,30))) {
+            g_audio.setShuffle(!shuffle);
+            QueueNextTrack();
+        }
         ImGui::PopStyleColor();
 
         ImGui::PopFont();
@@ -8,6 +8,7 @@
 #include <thread>
 #include <atomic>
 #include <optional>
+#include <random>
 
 #include "files.h"
 #include "audiomanager.h"
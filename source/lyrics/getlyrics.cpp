@@ -23,7 +23,13 @@ static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* use
     return size * nmemb;
 }
 
-std::string FetchLyrics(const std::string& title, const std::string& artist) {
+static int ProgressCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    const auto* cancelled = static_cast<const std::function<bool()>*>(clientp);
+    return (*cancelled)() ? 1 : 0;
+}
+
+std::string FetchLyrics(const std::string& title, const std::string& artist,
+                        const std::function<bool()>& cancelled) {
     CURL* curl = curl_easy_init();
     if (!curl) return "";
 
@@ -39,10 +45,16 @@ std::string FetchLyrics(const std::string& title, const std::string& artist) {
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "Vesper (https://github.com/rksaiz/Vesper)");
+    if (cancelled) {
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &cancelled);
+    }
 
     CURLcode res = curl_easy_perform(curl);
     curl_easy_cleanup(curl);
 
+    if (res == CURLE_ABORTED_BY_CALLBACK) return "";
     if (res != CURLE_OK) {
         std::cerr << "Curl error: " << curl_easy_strerror(res) << std::endl;
         return "";
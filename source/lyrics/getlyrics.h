@@ -5,7 +5,10 @@
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <sstream>
+#include <functional>
 
-std::string FetchLyrics(const std::string& title, const std::string& artist);
+// `cancelled` is polled during the transfer; returning true aborts it.
+std::string FetchLyrics(const std::string& title, const std::string& artist,
+                        const std::function<bool()>& cancelled = nullptr);
 
 #endif
\ No newline at end of file
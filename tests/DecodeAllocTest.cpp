@@ -0,0 +1,136 @@
+// Checks that the steady-state decode path makes no heap allocations.
+// operator new calls made on the decoding thread inside read() are counted
+// while a generated WAV file is decoded, once without caches and once
+// capturing into a PcmCache. The read-ahead thread and FFmpeg's own
+// av_malloc calls (packet payloads) are not counted.
+
+#include "AudioDecoder.h"
+#include "PcmCache.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+static thread_local bool g_counting = false;
+static uint64_t          g_allocations = 0;
+
+void* operator new(size_t size) {
+    if (g_counting) ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr int    RATE     = 44100;
+constexpr int    CHANNELS = 2;
+constexpr int    SECONDS  = 30;
+constexpr size_t CHUNK    = 4096;
+
+void Put16(std::FILE* f, uint16_t v) { std::fwrite(&v, 2, 1, f); }
+void Put32(std::FILE* f, uint32_t v) { std::fwrite(&v, 4, 1, f); }
+
+bool WriteWav(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+
+    const uint32_t frames = RATE * SECONDS;
+    const uint32_t dataBytes = frames * CHANNELS * 2;
+    std::fwrite("RIFF", 1, 4, f);
+    Put32(f, 36 + dataBytes);
+    std::fwrite("WAVEfmt ", 1, 8, f);
+    Put32(f, 16);
+    Put16(f, 1);
+    Put16(f, CHANNELS);
+    Put32(f, RATE);
+    Put32(f, RATE * CHANNELS * 2);
+    Put16(f, CHANNELS * 2);
+    Put16(f, 16);
+    std::fwrite("data", 1, 4, f);
+    Put32(f, dataBytes);
+
+    std::vector<int16_t> frame(CHANNELS);
+    for (uint32_t i = 0; i < frames; ++i) {
+        int16_t s = static_cast<int16_t>(8000.0 * std::sin(2.0 * M_PI * 440.0 * i / RATE));
+        for (int c = 0; c < CHANNELS; ++c) frame[c] = s;
+        std::fwrite(frame.data(), 2, CHANNELS, f);
+    }
+    return std::fclose(f) == 0;
+}
+
+// Decodes `path` to the end and returns the allocations made after the
+// first `warmupSeconds`, stopping one chunk short of the end, where a
+// finished capture is handed to the cache.
+uint64_t DecodeAllocations(const std::string& path, PcmCache* cache, double warmupSeconds) {
+    PacketReader::Control control;
+    control.maxSeconds = 1.0;
+
+    AudioDecoder decoder;
+    decoder.setReadAhead(&control);
+    decoder.setCache(cache);
+    if (!decoder.open(path)) {
+        std::cerr << "Could not open " << path << "\n";
+        std::exit(1);
+    }
+
+    std::vector<float> out(CHUNK * CHANNELS);
+    const size_t warmup = static_cast<size_t>(warmupSeconds * RATE);
+    const size_t stop = static_cast<size_t>(RATE) * SECONDS - 2 * CHUNK;
+    size_t decoded = 0;
+    while (decoded < warmup)
+        decoded += decoder.read(out.data(), CHUNK);
+
+    // Let the reader fill its queue, so its ring has reached full size.
+    for (int i = 0; i < 200 && control.readStalls.load() == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    g_allocations = 0;
+    while (decoded < stop) {
+        g_counting = true;
+        size_t n = decoder.read(out.data(), CHUNK);
+        g_counting = false;
+        if (n == 0) break;
+        decoded += n;
+    }
+    return g_allocations;
+}
+
+} // namespace
+
+int main() {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "vesper-decode-alloc-test.wav").string();
+    if (!WriteWav(path)) {
+        std::cerr << "Could not write " << path << "\n";
+        return 1;
+    }
+
+    int failures = 0;
+
+    uint64_t plain = DecodeAllocations(path, nullptr, 2.0);
+    std::cout << "uncached decode: " << plain << " allocations\n";
+    if (plain != 0) ++failures;
+
+    // Past the start, the capture reserves the rest of the track once.
+    PcmCache cache(256u << 20);
+    uint64_t captured = DecodeAllocations(path, &cache, 2.0);
+    std::cout << "captured decode: " << captured << " allocations\n";
+    if (captured > 1) ++failures;
+
+    std::filesystem::remove(path);
+    if (failures) std::cerr << "FAILED\n";
+    return failures ? 1 : 0;
+}